@@ -0,0 +1,90 @@
+// Measures the startup cost of loading configuration defaults: parsing the text format into a map and
+// looking the bound keys up in it, versus mapping the compiled binary format and installing the bound
+// keys as bottom-of-chain scoped values.
+
+#include "scoped_config.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+using clock_type = std::chrono::steady_clock;
+
+static double seconds_since(clock_type::time_point start) {
+    return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+static const size_t num_keys = 4096;
+static const int num_bound = 256;
+
+template<int I> using Setting = scoped::scoped<int64_t, std::integral_constant<int, I>>;
+template<int I> using Name = scoped::scoped<std::string_view, std::integral_constant<int, I>>;
+
+static std::string key_of(size_t i) {
+    return "service.module" + std::to_string(i % 64) + ".setting" + std::to_string(i);
+}
+
+template<int... I> static bool bind_all(std::integer_sequence<int, I...>) {
+    return (scoped::config_file::bind<Setting<I>>(strdup(key_of(2 * I).c_str())) && ...) &&
+        (scoped::config_file::bind<Name<I>>(strdup(key_of(2 * I + 1).c_str())) && ...);
+}
+
+// Keeps the loaded values observable, so that the loops are not optimized away.
+volatile int64_t g_sink;
+
+static std::string write_file(const std::string& content) {
+    char path[] = "/tmp/scoped_bench_config_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || write(fd, content.data(), content.size()) != ssize_t(content.size())) std::abort();
+    close(fd);
+    return path;
+}
+
+int main() {
+    bind_all(std::make_integer_sequence<int, num_bound / 2>());
+
+    std::string text;
+    for (size_t i = 0; i < num_keys; ++i) {
+        text += key_of(i) + " = " + (i % 2 ? "\"value " + std::to_string(i) + "\"" : std::to_string(i * 7)) + "\n";
+    }
+    std::string text_path = write_file(text), binary_path = write_file(scoped::compile_config(text));
+    const int rounds = 200;
+
+    {
+        auto start = clock_type::now();
+        for (int r = 0; r < rounds; ++r) {
+            std::ifstream input(text_path);
+            std::stringstream content;
+            content << input.rdbuf();
+            std::string all = content.str();
+            std::deque<std::string> storage;
+            std::unordered_map<std::string, std::string> values;
+            scoped::parse_config(all, storage, [&values](std::string_view key, const scoped::config_value& value) {
+                values[std::string(key)] = value.type == scoped::config_type::string ?
+                    std::string(value.string) : std::to_string(value.integer);
+            });
+            int64_t sum = 0;
+            for (int i = 0; i < num_bound / 2; ++i) {
+                sum += std::stoll(values[key_of(2 * i)]) + int64_t(values[key_of(2 * i + 1)].size());
+            }
+            g_sink = sum;
+        }
+        std::printf("parse text:        %8.1f us per load\n", seconds_since(start) / rounds * 1e6);
+    }
+    {
+        auto start = clock_type::now();
+        for (int r = 0; r < rounds; ++r) {
+            scoped::config_file config(binary_path);
+            auto defaults = config.install();
+            g_sink = Setting<0>::top()->value() + int64_t(defaults.size());
+        }
+        std::printf("map binary:        %8.1f us per load\n", seconds_since(start) / rounds * 1e6);
+    }
+
+    std::remove(text_path.c_str());
+    std::remove(binary_path.c_str());
+    return 0;
+}
@@ -0,0 +1,104 @@
+// Measures the overhead of scoped::cost_center push/pop and context switches, and the accuracy of
+// the CPU time it charges when work for several tenants hops between threads.
+
+#include "scoped_cost_center.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+using clock_type = std::chrono::steady_clock;
+
+static double ns_per_op(clock_type::time_point start, int ops) {
+    return std::chrono::duration<double, std::nano>(clock_type::now() - start).count() / ops;
+}
+
+static void burn(uint64_t ns) {
+    uint64_t start = scoped::cost_center::thread_cpu_ns();
+    while (scoped::cost_center::thread_cpu_ns() - start < ns);
+}
+
+int main() {
+    const int iterations = 1000000;
+    scoped::cost_account account("bench");
+
+    {
+        auto start = clock_type::now();
+        for (int i = 0; i < iterations; ++i) {
+            scoped::scoped<int> plain(i);
+        }
+        std::printf("scoped<int> push/pop:           %8.1f ns\n", ns_per_op(start, iterations));
+    }
+    {
+        auto start = clock_type::now();
+        for (int i = 0; i < iterations; ++i) {
+            scoped::cost_center billing(account);
+        }
+        std::printf("cost_center push/pop:           %8.1f ns\n", ns_per_op(start, iterations));
+    }
+    {
+        scoped::cost_center outer(account);
+        auto start = clock_type::now();
+        for (int i = 0; i < iterations; ++i) {
+            scoped::cost_center nested(account);
+        }
+        std::printf("nested cost_center push/pop:    %8.1f ns\n", ns_per_op(start, iterations));
+    }
+    {
+        scoped::cost_center billing(account);
+        auto ctx = scoped::context::capture();
+        std::thread worker([&ctx, iterations] {
+            auto start = clock_type::now();
+            for (int i = 0; i < iterations; ++i) {
+                auto guard = ctx.install();
+            }
+            std::printf("context install/remove:         %8.1f ns\n", ns_per_op(start, iterations));
+        });
+        worker.join();
+    }
+
+    // Accuracy: each tenant's work is split into slices that run on whichever worker is free.
+    const int tenants = 4;
+    const int slices = 200;
+    const uint64_t slice_ns = 100000;
+    std::vector<scoped::cost_account*> accounts;
+    for (int t = 0; t < tenants; ++t) {
+        accounts.push_back(new scoped::cost_account("tenant" + std::to_string(t)));
+    }
+    std::vector<scoped::context> contexts(tenants);
+    std::vector<std::thread> workers;
+    std::atomic<int> next_slice(0);
+    {
+        for (int t = 0; t < tenants; ++t) {
+            // Capture each tenant's context from its own cost center on this thread
+            scoped::cost_center billing(*accounts[t]);
+            contexts[t] = scoped::context::capture();
+        }
+    }
+    std::atomic<uint64_t> worker_cpu_ns(0);
+    for (int w = 0; w < 4; ++w) {
+        workers.emplace_back([&] {
+            uint64_t start = scoped::cost_center::thread_cpu_ns();
+            for (int s; (s = next_slice++) < tenants * slices;) {
+                auto guard = contexts[s % tenants].install();
+                burn(slice_ns);
+            }
+            worker_cpu_ns += scoped::cost_center::thread_cpu_ns() - start;
+        });
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    uint64_t charged = 0;
+    for (auto account : accounts) {
+        std::printf("%s charged %.3f ms (expected %.3f ms)\n", account->name().c_str(),
+                    account->cpu_ns() / 1e6, slices * slice_ns / 1e6);
+        charged += account->cpu_ns();
+        delete account;
+    }
+    std::printf("charged %.3f ms of %.3f ms worker CPU time (%.2f%%)\n", charged / 1e6,
+                worker_cpu_ns.load() / 1e6, 100.0 * charged / worker_cpu_ns.load());
+    return 0;
+}
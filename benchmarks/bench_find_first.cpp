@@ -0,0 +1,59 @@
+// Measures finding the innermost decorator of a given concrete type in a chain of 16 decorators of
+// four types, with abstract_scoped::find_first<D>() against walking next() with dynamic_cast.
+
+#include "scoped.h"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using clock_type = std::chrono::steady_clock;
+
+struct TextDecorator {
+    virtual ~TextDecorator() = default;
+    virtual int weight() const = 0;
+};
+
+template<int I> struct Decorator : TextDecorator {
+    int weight() const override { return I; }
+};
+
+// Derives from another decorator, so that dynamic_cast has a hierarchy to walk.
+struct Fancy : Decorator<1> {
+    int weight() const override { return 100; }
+};
+
+using Decorators = scoped::abstract_scoped<TextDecorator>;
+
+// Keeps the results observable, so that the loops are not optimized away.
+volatile int g_sink;
+
+static const int num_lookups = 1 << 22;
+
+template<class F> static void measure(const char* label, F&& find) {
+    auto start = clock_type::now();
+    for (int i = 0; i < num_lookups; ++i) {
+        g_sink = find()->weight();
+    }
+    double seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+    std::printf("%-24s %7.1f ns/lookup\n", label, seconds / num_lookups * 1e9);
+}
+
+int main() {
+    // Fancy at the bottom, under 15 other decorators
+    scoped::polymorphic_scoped<Fancy, TextDecorator> fancy;
+    std::vector<scoped::polymorphic_scoped<Decorator<0>, TextDecorator>> zeros(5);
+    std::vector<scoped::polymorphic_scoped<Decorator<1>, TextDecorator>> ones(5);
+    std::vector<scoped::polymorphic_scoped<Decorator<2>, TextDecorator>> twos(5);
+
+    measure("dynamic_cast", [] {
+        for (auto p = Decorators::top(); p; p = p->next()) {
+            if (auto d = dynamic_cast<Fancy*>(&p->value())) return d;
+        }
+        return static_cast<Fancy*>(nullptr);
+    });
+    measure("find_first", [] {
+        return Decorators::find_first<Fancy>();
+    });
+    return 0;
+}
@@ -0,0 +1,62 @@
+// Measures the cost of recording into a scoped::histogram, compared to a shared histogram of atomic
+// buckets, and the cost of merging two histograms.
+
+#include "scoped_histogram.h"
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+using clock_type = std::chrono::steady_clock;
+
+static double ns_since(clock_type::time_point start) {
+    return std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+}
+
+int main() {
+    const size_t count = 1 << 24;
+    std::vector<uint64_t> values(4096);
+    uint64_t x = 88172645463325252ull;
+    for (auto& v : values) {
+        x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+        v = x % 1000000;
+    }
+
+    {
+        scoped::histogram latencies;
+        auto start = clock_type::now();
+        for (size_t i = 0; i < count; ++i) {
+            latencies.record(values[i % values.size()]);
+        }
+        std::printf("histogram::record:          %6.2f ns\n", ns_since(start) / count);
+    }
+    {
+        scoped::histogram latencies;
+        auto start = clock_type::now();
+        for (size_t i = 0; i < count; ++i) {
+            scoped::histogram::record_in_scope(values[i % values.size()]);
+        }
+        std::printf("histogram::record_in_scope: %6.2f ns\n", ns_since(start) / count);
+    }
+    {
+        std::vector<std::atomic<uint64_t>> shared(scoped::histogram_data::num_buckets);
+        auto start = clock_type::now();
+        for (size_t i = 0; i < count; ++i) {
+            shared[scoped::histogram_data::bucket_of(values[i % values.size()])].fetch_add(1, std::memory_order_relaxed);
+        }
+        std::printf("shared atomic buckets:      %6.2f ns\n", ns_since(start) / count);
+    }
+    {
+        scoped::histogram_data a, b;
+        for (auto v : values) {
+            b.record(v);
+        }
+        const int merges = 100000;
+        auto start = clock_type::now();
+        for (int i = 0; i < merges; ++i) {
+            a.merge(b);
+        }
+        std::printf("merge (%zu buckets):      %6.0f ns\n", scoped::histogram_data::num_buckets, ns_since(start) / merges);
+        std::printf("p50 %llu p99 %llu\n", (unsigned long long)a.percentile(50), (unsigned long long)a.percentile(99));
+    }
+    return 0;
+}
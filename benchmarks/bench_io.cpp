@@ -0,0 +1,85 @@
+// Measures 4K random reads of a local file: one pread() per read, and through scoped::io_batch with the
+// io_uring and thread_pool backends. Pass a file path to read an existing file, and -d to use O_DIRECT.
+
+#include "scoped_io.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <random>
+#include <string>
+#include <vector>
+
+using clock_type = std::chrono::steady_clock;
+
+static double seconds_since(clock_type::time_point start) {
+    return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+static const size_t block = 4096;
+
+static void report(const char* label, size_t reads, clock_type::time_point start) {
+    std::printf("%-28s %8.1f K reads/s\n", label, reads / seconds_since(start) / 1e3);
+}
+
+int main(int argc, char** argv) {
+    bool direct = false;
+    std::string path;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-d") == 0) direct = true;
+        else path = argv[i];
+    }
+    bool temporary = path.empty();
+    if (temporary) {
+        char name[] = "/tmp/scoped_bench_io_XXXXXX";
+        int fd = mkstemp(name);
+        std::vector<char> data(1 << 20, 'x');
+        for (int i = 0; i < 64; ++i) {
+            if (::write(fd, data.data(), data.size()) != ssize_t(data.size())) return 1;
+        }
+        close(fd);
+        path = name;
+    }
+    int fd = open(path.c_str(), O_RDONLY | (direct ? O_DIRECT : 0));
+    if (fd < 0) {
+        std::perror(path.c_str());
+        return 1;
+    }
+    off_t blocks = lseek(fd, 0, SEEK_END) / off_t(block);
+
+    const size_t reads = 1 << 16, depth = 64;
+    std::mt19937_64 gen(42);
+    std::vector<off_t> offsets(reads);
+    for (auto& o : offsets) o = off_t(gen() % uint64_t(blocks)) * off_t(block);
+    void* memory = nullptr;
+    if (posix_memalign(&memory, block, block * depth)) return 1;
+    char* buffers = static_cast<char*>(memory);
+
+    {
+        auto start = clock_type::now();
+        for (size_t i = 0; i < reads; ++i) {
+            if (pread(fd, buffers + (i % depth) * block, block, offsets[i]) != ssize_t(block)) return 1;
+        }
+        report("pread", reads, start);
+    }
+    for (auto backend : {scoped::io_backend::uring, scoped::io_backend::thread_pool}) {
+        auto start = clock_type::now();
+        bool available = true;
+        for (size_t i = 0; i < reads; i += depth) {
+            scoped::io_batch batch(depth, backend);
+            available = batch.backend() == backend;
+            for (size_t j = 0; j < depth; ++j) {
+                scoped::read(fd, buffers + j * block, block, offsets[i + j]);
+            }
+        }
+        if (available) {
+            report(backend == scoped::io_backend::uring ? "io_batch, io_uring" : "io_batch, thread_pool", reads, start);
+        }
+    }
+
+    free(memory);
+    close(fd);
+    if (temporary) unlink(path.c_str());
+    return 0;
+}
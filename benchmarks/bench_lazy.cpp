@@ -0,0 +1,57 @@
+// Measures a request mix where 10% of the requests read an expensive scoped value, a ruleset of 256
+// parsed rules: built eagerly in every request with scoped::scoped, or on first use with scoped::lazy.
+
+#include "scoped_lazy.h"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+
+using clock_type = std::chrono::steady_clock;
+
+struct Ruleset {
+    explicit Ruleset(int tenant) {
+        for (int i = 0; i < 256; ++i) {
+            rules.emplace("rule." + std::to_string(tenant) + "." + std::to_string(i), i);
+        }
+    }
+    std::unordered_map<std::string, int> rules;
+};
+
+using Rules = scoped::abstract_scoped<Ruleset>;
+
+// Keeps the results observable, so that the loops are not optimized away.
+volatile size_t g_sink;
+
+static const int num_requests = 20000;
+
+// Reads the ruleset in one request out of ten.
+static void serve(int request) {
+    if (request % 10 == 0) {
+        g_sink = Rules::top()->value().rules.size();
+    }
+    else {
+        g_sink = size_t(request);
+    }
+}
+
+template<class F> static void measure(const char* label, F&& request) {
+    auto start = clock_type::now();
+    for (int i = 0; i < num_requests; ++i) {
+        request(i);
+    }
+    double seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+    std::printf("%-24s %8.2f us/request\n", label, seconds / num_requests * 1e6);
+}
+
+int main() {
+    measure("eager scoped", [](int i) {
+        scoped::scoped<Ruleset> rules(i);
+        serve(i);
+    });
+    measure("lazy", [](int i) {
+        scoped::lazy<Ruleset> rules([i] { return Ruleset(i); });
+        serve(i);
+    });
+    return 0;
+}
@@ -0,0 +1,59 @@
+// Compares scoped::lifo with scoped::scoped: the size of an instance, the stack used per frame of a
+// recursion that opens a scope in every frame, and the latency of pushing and popping a scope.
+
+#include "scoped_lifo.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+using clock_type = std::chrono::steady_clock;
+using Scoped = scoped::scoped<int, struct ScopedTag>;
+using Lifo = scoped::lifo<int, struct LifoTag>;
+
+// Keeps the values observable, so that the loops are not optimized away.
+volatile int g_sink;
+
+static const int depth = 10000;
+static const int num_rounds = 500;
+static const int num_pushes = 1 << 24;
+
+static uintptr_t g_deepest;
+
+// Opens a scope in every frame, down to the given number of levels, and records the deepest stack address.
+template<class S> __attribute__((noinline)) static int recurse(int levels) {
+    S scope(levels);
+    if (!levels) {
+        g_deepest = uintptr_t(&scope);
+        return S::top()->value();
+    }
+    return recurse<S>(levels - 1) + 1;
+}
+
+template<class S> static void measure(const char* label) {
+    int top = 0;
+    uintptr_t base = uintptr_t(&top);
+    g_sink = recurse<S>(depth);
+    double per_frame = double(base - g_deepest) / depth;
+
+    auto start = clock_type::now();
+    for (int round = 0; round < num_rounds; ++round) {
+        g_sink = recurse<S>(depth);
+    }
+    double recursion = std::chrono::duration<double>(clock_type::now() - start).count() / num_rounds / depth;
+
+    start = clock_type::now();
+    for (int i = 0; i < num_pushes; ++i) {
+        S scope(i);
+        g_sink = S::top()->value();
+    }
+    double push_pop = std::chrono::duration<double>(clock_type::now() - start).count() / num_pushes;
+
+    std::printf("%-10s %3zu bytes  %6.1f stack bytes/frame  %6.2f ns/frame  %6.2f ns/push+pop\n", label,
+        sizeof(S), per_frame, recursion * 1e9, push_pop * 1e9);
+}
+
+int main() {
+    measure<Scoped>("scoped");
+    measure<Lifo>("lifo");
+    return 0;
+}
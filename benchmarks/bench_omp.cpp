@@ -0,0 +1,56 @@
+// Measures the cost of entering an OpenMP parallel region with SCOPED_OMP_PARALLEL, compared to a
+// plain "#pragma omp parallel", for 1 to 64 threads.
+
+#include "scoped_omp.h"
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using ScopedThreshold = scoped::scoped<int, struct ThresholdTag>;
+using ScopedTenant = scoped::scoped<std::string, struct TenantTag>;
+using ScopedDeadline = scoped::scoped<long, struct DeadlineTag>;
+static const bool propagated = scoped::context::propagate<ScopedThreshold>() &&
+                               scoped::context::propagate<ScopedTenant>() &&
+                               scoped::context::propagate<ScopedDeadline>();
+
+using clock_type = std::chrono::steady_clock;
+
+// Written by every thread of every region, so that the regions are not optimized away.
+volatile int g_sink;
+
+static double us_since(clock_type::time_point start) {
+    return std::chrono::duration<double, std::micro>(clock_type::now() - start).count();
+}
+
+int main() {
+    const int regions = 2000;
+    ScopedThreshold threshold(100);
+    ScopedTenant tenant("acme");
+    ScopedDeadline deadline(1000);
+
+    std::printf("threads\tplain us/region\tscoped us/region\n");
+    for (int threads = 1; threads <= 64; threads *= 2) {
+        auto start = clock_type::now();
+        for (int r = 0; r < regions; ++r) {
+            #pragma omp parallel num_threads(threads)
+            {
+                g_sink = 1;
+            }
+        }
+        double plain = us_since(start) / regions;
+
+        start = clock_type::now();
+        for (int r = 0; r < regions; ++r) {
+            SCOPED_OMP_PARALLEL(num_threads(threads)) {
+                g_sink = ScopedThreshold::top()->value();
+            }
+        }
+        double scoped = us_since(start) / regions;
+        std::printf("%d\t%.2f\t\t%.2f\n", threads, plain, scoped);
+    }
+    return propagated ? 0 : 1;
+}
@@ -0,0 +1,82 @@
+// Measures the cost of dispatching callbacks with and without bound scoped contexts: calling through
+// std::function directly, and through an epoll reactor.
+
+#include "scoped_reactor.h"
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <sys/eventfd.h>
+
+using clock_type = std::chrono::steady_clock;
+using RequestId = scoped::scoped<uint64_t, struct RequestIdTag>;
+using Deadline = scoped::scoped<uint64_t, struct DeadlineTag>;
+using Tenant = scoped::scoped<std::string, struct TenantTag>;
+
+static const bool propagated = scoped::context::propagate<RequestId>() &&
+    scoped::context::propagate<Deadline>() && scoped::context::propagate<Tenant>();
+
+// Keeps the callbacks observable, so that the loops are not optimized away.
+volatile uint64_t g_sink;
+
+static double seconds_since(clock_type::time_point start) {
+    return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+static void callback(uint32_t events) {
+    g_sink = g_sink + events + (RequestId::top() ? RequestId::top()->value() : 0);
+}
+
+static void measure_calls(const char* label, const std::function<void(uint32_t)>& f, size_t count) {
+    auto start = clock_type::now();
+    for (size_t i = 0; i < count; ++i) {
+        f(uint32_t(i));
+    }
+    std::printf("%-36s %8.1f ns/call\n", label, seconds_since(start) / count * 1e9);
+}
+
+static void measure_reactor(const char* label, size_t count) {
+    scoped::reactor loop;
+    int fd = eventfd(0, EFD_NONBLOCK);
+    loop.add(fd, EPOLLIN, [fd](uint32_t events) {
+        uint64_t value;
+        if (read(fd, &value, sizeof(value)) == sizeof(value)) {
+            callback(events);
+        }
+    });
+    auto start = clock_type::now();
+    uint64_t one = 1;
+    for (size_t i = 0; i < count; ++i) {
+        if (write(fd, &one, sizeof(one)) != sizeof(one) || loop.run_once() != 1) {
+            std::printf("dispatch failed\n");
+            break;
+        }
+    }
+    std::printf("%-36s %8.1f ns/dispatch\n", label, seconds_since(start) / count * 1e9);
+    close(fd);
+}
+
+int main() {
+    const size_t count = 1 << 22;
+    if (!propagated) return 1;
+
+    measure_calls("std::function", callback, count);
+    measure_calls("bind, no scoped values", scoped::bind(callback), count);
+    {
+        RequestId id(uint64_t(42));
+        measure_calls("bind, 1 scoped value", scoped::bind(callback), count);
+        Deadline deadline(uint64_t(1000));
+        Tenant tenant("acme");
+        measure_calls("bind, 3 scoped values", scoped::bind(callback), count);
+    }
+
+    const size_t dispatches = 1 << 18;
+    measure_reactor("reactor, no scoped values", dispatches);
+    {
+        RequestId id(uint64_t(42));
+        Deadline deadline(uint64_t(1000));
+        Tenant tenant("acme");
+        measure_reactor("reactor, 3 scoped values", dispatches);
+    }
+    return 0;
+}
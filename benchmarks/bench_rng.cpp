@@ -0,0 +1,84 @@
+// Measures the throughput of scoped::rng per core, drawing one number at a time and in blocks, and the
+// cost of deriving a child stream per task.
+
+#include "scoped_rng.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+using clock_type = std::chrono::steady_clock;
+
+// Keeps the generated numbers observable, so that the loops are not optimized away.
+volatile uint64_t g_sink;
+
+static double seconds_since(clock_type::time_point start) {
+    return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+int main() {
+    const size_t count = 1 << 26;
+    uint64_t sink = 0;
+    scoped::rng root(42);
+
+    {
+        auto start = clock_type::now();
+        for (size_t i = 0; i < count; ++i) {
+            sink += root.next_u32();
+        }
+        std::printf("next_u32:           %8.1f M numbers/s\n", count / seconds_since(start) / 1e6);
+    }
+    {
+        std::vector<uint32_t> block(4096);
+        auto start = clock_type::now();
+        for (size_t i = 0; i < count; i += block.size()) {
+            root.fill(block.data(), block.size());
+            sink += block[i % block.size()];
+        }
+        std::printf("fill (4096 blocks): %8.1f M numbers/s\n", count / seconds_since(start) / 1e6);
+    }
+    {
+        std::mt19937 mt(42);
+        auto start = clock_type::now();
+        for (size_t i = 0; i < count; ++i) {
+            sink += mt();
+        }
+        std::printf("std::mt19937:       %8.1f M numbers/s\n", count / seconds_since(start) / 1e6);
+    }
+    {
+        const size_t tasks = 1 << 22;
+        auto start = clock_type::now();
+        for (size_t i = 0; i < tasks; ++i) {
+            scoped::rng child(i);
+            sink += child.next_u32();
+        }
+        std::printf("derive child + draw:%8.1f ns\n", seconds_since(start) * 1e9 / tasks);
+    }
+
+    // Throughput with all cores drawing from their own derived streams
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    auto ctx = scoped::context::capture();
+    std::vector<std::thread> workers;
+    std::vector<uint64_t> sinks(threads);
+    auto start = clock_type::now();
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            auto guard = ctx.install();
+            scoped::rng rng(t);
+            std::vector<uint32_t> block(4096);
+            for (size_t i = 0; i < count; i += block.size()) {
+                rng.fill(block.data(), block.size());
+                sinks[t] += block[0];
+            }
+        });
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    double rate = threads * double(count) / seconds_since(start) / 1e6;
+    std::printf("fill on %u threads: %8.1f M numbers/s (%.1f per core)\n", threads, rate, rate / threads);
+    g_sink = sink + sinks[0];
+    return 0;
+}
@@ -0,0 +1,62 @@
+// Measures growing vectors of scoped values to 10k elements, without reserving: std::vector with moves
+// that may throw (which copies the elements when it grows, as it did before moves were noexcept),
+// std::vector with noexcept moves, and scoped::scoped_vector, which relinks its elements in bulk.
+
+#include "scoped_vector.h"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using clock_type = std::chrono::steady_clock;
+
+// A value whose move constructor may throw, so that std::vector copies it when it grows.
+struct throwing_move {
+    throwing_move(std::string s) : text(std::move(s)) {}
+    throwing_move(const throwing_move&) = default;
+    throwing_move(throwing_move&& other) noexcept(false) : text(std::move(other.text)) {}
+    std::string text;
+};
+
+// Keeps the vectors observable, so that the loops are not optimized away.
+volatile size_t g_sink;
+
+static const size_t num_elements = 10000;
+static const int num_rounds = 200;
+
+template<class F> static void measure(const char* label, F&& grow) {
+    auto start = clock_type::now();
+    for (int round = 0; round < num_rounds; ++round) {
+        grow();
+    }
+    double seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+    std::printf("%-44s %8.1f us/vector\n", label, seconds / num_rounds * 1e6);
+}
+
+int main() {
+    // Longer than the small string buffer, so that copies allocate
+    const std::string text(40, 't');
+
+    measure("std::vector, copies on growth (before)", [&] {
+        std::vector<scoped::scoped<throwing_move>> v;
+        for (size_t i = 0; i < num_elements; ++i) v.emplace_back(text);
+        g_sink = v.size();
+    });
+    measure("std::vector, noexcept moves", [&] {
+        std::vector<scoped::scoped<std::string>> v;
+        for (size_t i = 0; i < num_elements; ++i) v.emplace_back(text);
+        g_sink = v.size();
+    });
+    measure("scoped_vector, bulk relinking", [&] {
+        scoped::scoped_vector<std::string> v;
+        for (size_t i = 0; i < num_elements; ++i) v.emplace_back(text);
+        g_sink = v.size();
+    });
+    measure("scoped_vector, reserved", [&] {
+        scoped::scoped_vector<std::string> v;
+        v.reserve(num_elements);
+        for (size_t i = 0; i < num_elements; ++i) v.emplace_back(text);
+        g_sink = v.size();
+    });
+    return 0;
+}
@@ -0,0 +1,90 @@
+// Measures the latency of taking a snapshot of a scoped::shm_global value, idle and while another
+// process stores new values continuously or periodically. Latencies include the cost of reading the clock,
+// which is measured separately.
+
+#include "scoped_shm.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <signal.h>
+#include <sys/wait.h>
+
+using clock_type = std::chrono::steady_clock;
+
+struct knobs {
+    uint32_t batch_size;
+    uint32_t max_connections;
+    double sample_rate;
+    uint64_t limits[12];
+};
+
+using Knobs = scoped::scoped<knobs, struct KnobsTag>;
+
+// Keeps the snapshots observable, so that the loops are not optimized away.
+volatile uint64_t g_sink;
+
+static const size_t num_reads = 1 << 20;
+
+// Stores new values until killed, pausing for pause_us microseconds between stores.
+static pid_t start_writer(const std::string& name, unsigned pause_us) {
+    pid_t child = fork();
+    if (child == 0) {
+        scoped::shm_global<knobs, struct KnobsTag> writer(name);
+        knobs k = {};
+        for (uint32_t i = 0;; ++i) {
+            k.batch_size = i;
+            writer.store(k);
+            if (pause_us) usleep(pause_us);
+        }
+    }
+    return child;
+}
+
+static void stop_writer(pid_t child) {
+    if (child > 0) {
+        kill(child, SIGKILL);
+        waitpid(child, nullptr, 0);
+    }
+}
+
+template<class F> static void measure(const char* label, F&& read) {
+    std::vector<uint32_t> latencies(num_reads);
+    auto start = clock_type::now();
+    for (size_t i = 0; i < num_reads; ++i) {
+        auto before = clock_type::now();
+        read();
+        latencies[i] = uint32_t(std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - before).count());
+    }
+    double total = std::chrono::duration<double>(clock_type::now() - start).count();
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) { return latencies[size_t(p * (num_reads - 1))]; };
+    std::printf("%-36s %7.1f ns/read  p50 %5u  p99 %6u  p99.99 %8u ns\n", label, total / num_reads * 1e9,
+        percentile(0.5), percentile(0.99), percentile(0.9999));
+}
+
+int main() {
+    const std::string name = "/scoped_shm_bench_" + std::to_string(getpid());
+    scoped::shm_segment::unlink(name);
+    scoped::shm_global<knobs, struct KnobsTag> global(name);
+
+    auto snapshot = [&] {
+        auto scope = global.snapshot();
+        g_sink = Knobs::top()->value().batch_size;
+    };
+
+    measure("clock only", [] { g_sink = 0; });
+    measure("snapshot, idle", snapshot);
+
+    pid_t writer = start_writer(name, 100);
+    measure("snapshot, store every 100us", snapshot);
+    stop_writer(writer);
+
+    writer = start_writer(name, 0);
+    measure("snapshot, continuous stores", snapshot);
+    stop_writer(writer);
+
+    scoped::shm_segment::unlink(name);
+    return 0;
+}
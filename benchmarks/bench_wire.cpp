@@ -0,0 +1,102 @@
+// Measures round trips of small messages between two processes over a Unix socket pair, with and
+// without the scoped context (tenant, deadline, flags, trace id) encoded in a scoped::wire header, and
+// the cost of encoding and decoding alone.
+
+#include "scoped_wire.h"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using clock_type = std::chrono::steady_clock;
+using Tenant = scoped::scoped<std::string_view, struct TenantTag>;
+using Deadline = scoped::scoped<int64_t, struct DeadlineTag>;
+using Flags = scoped::scoped<uint32_t, struct FlagsTag>;
+using Trace = scoped::scoped<uint64_t, struct TraceTag>;
+
+static const bool shipped = scoped::wire::propagate<Tenant>(1) && scoped::wire::propagate<Deadline>(2) &&
+    scoped::wire::propagate<Flags>(3) && scoped::wire::propagate<Trace>(4);
+
+// Keeps the decoded values observable, so that the loops are not optimized away.
+volatile uint64_t g_sink;
+
+static double seconds_since(clock_type::time_point start) {
+    return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+// Answers every message with one byte, after installing its context if it has one.
+static void serve(int fd, bool with_context) {
+    char buffer[4096];
+    for (;;) {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) return;
+        uint64_t trace = 0;
+        if (with_context) {
+            auto guard = scoped::wire::install(buffer, size_t(n));
+            trace = Trace::top()->value();
+        }
+        char reply = char(trace);
+        if (send(fd, &reply, 1, 0) != 1) return;
+    }
+}
+
+static void measure(const char* label, bool with_context, size_t count) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) < 0) return;
+    pid_t child = fork();
+    if (child == 0) {
+        close(fds[0]);
+        serve(fds[1], with_context);
+        _exit(0);
+    }
+    close(fds[1]);
+    std::string message;
+    const std::string payload(64, 'p');
+    auto start = clock_type::now();
+    for (size_t i = 0; i < count; ++i) {
+        message.clear();
+        if (with_context) {
+            Trace trace(static_cast<uint64_t>(i));
+            scoped::wire::encode(message);
+        }
+        message += payload;
+        char reply;
+        if (send(fds[0], message.data(), message.size(), 0) < 0 || recv(fds[0], &reply, 1, 0) != 1) break;
+    }
+    std::printf("%-32s %8.1f K round trips/s\n", label, count / seconds_since(start) / 1e3);
+    close(fds[0]);
+    waitpid(child, nullptr, 0);
+}
+
+int main() {
+    if (!shipped) return 1;
+    Tenant tenant("acme-corporation");
+    Deadline deadline(1700000000000);
+    Flags flags(0x5u);
+
+    const size_t count = 1 << 20;
+    std::string message;
+    {
+        auto start = clock_type::now();
+        for (size_t i = 0; i < count; ++i) {
+            message.clear();
+            Trace trace(static_cast<uint64_t>(i));
+            scoped::wire::encode(message);
+        }
+        std::printf("%-32s %8.1f ns/message (%zu bytes)\n", "encode", seconds_since(start) / count * 1e9, message.size());
+    }
+    {
+        auto start = clock_type::now();
+        for (size_t i = 0; i < count; ++i) {
+            auto guard = scoped::wire::install(message.data(), message.size());
+            g_sink = Trace::top()->value();
+        }
+        std::printf("%-32s %8.1f ns/message\n", "install", seconds_since(start) / count * 1e9);
+    }
+
+    measure("loopback, no context", false, 100000);
+    measure("loopback, with context", true, 100000);
+    return 0;
+}
@@ -0,0 +1,60 @@
+// Measures the cost of incrementing shared counters from all cores, directly with atomics and through
+// a scoped::write_combiner per request.
+
+#include "scoped_write_combiner.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using clock_type = std::chrono::steady_clock;
+
+scoped::combined_counter requests;
+scoped::combined_counter bytes;
+scoped::combined_counter hits;
+std::atomic<int64_t> direct_requests(0), direct_bytes(0), direct_hits(0);
+
+const int requests_per_thread = 20000;
+const int increments_per_request = 50;
+
+template<class F> double ns_per_increment(unsigned threads, F&& request) {
+    std::vector<std::thread> workers;
+    auto start = clock_type::now();
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&request] {
+            for (int r = 0; r < requests_per_thread; ++r) {
+                request();
+            }
+        });
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+    double ns = std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+    return ns / (double(threads) * requests_per_thread * increments_per_request * 3);
+}
+
+int main() {
+    unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::printf("threads\tatomic ns/inc\tcombined ns/inc\n");
+    for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+        double direct = ns_per_increment(threads, [] {
+            for (int i = 0; i < increments_per_request; ++i) {
+                direct_requests.fetch_add(1, std::memory_order_relaxed);
+                direct_bytes.fetch_add(i, std::memory_order_relaxed);
+                direct_hits.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+        double combined = ns_per_increment(threads, [] {
+            scoped::write_combiner combiner;
+            for (int i = 0; i < increments_per_request; ++i) {
+                requests.add(1);
+                bytes.add(i);
+                hits.add(1);
+            }
+        });
+        std::printf("%u\t%.2f\t\t%.2f\n", threads, direct, combined);
+    }
+    return requests.load() == direct_requests.load() ? 0 : 1;
+}
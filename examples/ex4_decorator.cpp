@@ -6,14 +6,16 @@
 // apply these decorators to log messages, with each decorator being applied within a
 // specific scope. 
 // We also demonstrate how to use this logging system in a multithreaded 
-// environment by having two threads log messages with different decorators, with
-// interleaving messages.
-#include <iostream>
+// environment by having two threads log messages with different decorators.
+// Messages are written with scoped::output: the messages of thread 1 interleave with
+// those of the main thread, while thread 2 logs within a scoped::output_buffer, so its
+// messages leave together, in a single system call, when the buffer goes out of scope.
+#include <algorithm>
 #include <string>
 #include <thread>
-#include <mutex>
 #include <chrono>
 #include "../include/scoped.h"
+#include "../include/scoped_output.h"
 
 class TextDecorator {
 public:
@@ -57,10 +59,8 @@ void log(const std::string& message) {
         decoratedMessage = pScope->value().apply(decoratedMessage);
     }
 
-    // Synchronize access to the standard output and print the decorated message
-    static std::mutex logMutex;
-    std::lock_guard<std::mutex> lock(logMutex);
-    std::cout << decoratedMessage << std::endl;
+    // Write the decorated message, or append it to the innermost output buffer
+    output(decoratedMessage + "\n");
 }
 
 void threadFunc1() {
@@ -74,6 +74,8 @@ void threadFunc1() {
 void threadFunc2() {
     ScopedIndentDecorator indent;
     ScopedUpperCaseDecorator upper;
+    // The messages of this thread are written together, when the buffer goes out of scope
+    output_buffer buffer;
     for (int i = 0; i < 5; ++i) {
         log("Thread 2: This message is upper case\nand indented");
         std::this_thread::sleep_for(std::chrono::milliseconds(100));
@@ -0,0 +1,40 @@
+// This example demonstrates how scoped::memo can cache the results of a function that depends on
+// scoped configuration. The cache key includes the fingerprint of the scoped values the function
+// reads, so changing the configuration in a nested scope never returns a stale result.
+
+#include "../include/scoped_memo.h"
+#include <iostream>
+
+// The number base used when formatting numbers. Fingerprinted, so that memo can key results by it.
+using ScopedBase = scoped::fingerprinted<int, struct ScopedBaseTag>;
+
+// Format a number in the scoped base (decimal by default)
+std::string format_number_impl(int n) {
+    std::cout << "Formatting " << n << std::endl;
+    int base = ScopedBase::top() ? ScopedBase::top()->value() : 10;
+    std::string digits;
+    do {
+        digits.insert(digits.begin(), "0123456789abcdef"[n % base]);
+        n /= base;
+    } while (n > 0);
+    return digits;
+}
+
+scoped::memo<std::string(int), ScopedBase> format_number(format_number_impl);
+
+int main()
+{
+    std::cout << format_number(255) << std::endl;       // Formats: 255
+    std::cout << format_number(255) << std::endl;       // Cached: 255
+    {
+        ScopedBase hex(16);
+        std::cout << format_number(255) << std::endl;   // Formats: ff
+        std::cout << format_number(255) << std::endl;   // Cached: ff
+        {
+            ScopedBase binary(2);
+            std::cout << format_number(255) << std::endl;   // Formats: 11111111
+        }
+        std::cout << format_number(255) << std::endl;   // Cached: ff
+    }
+    std::cout << format_number(255) << std::endl;       // Cached: 255
+}
@@ -13,6 +13,9 @@ Author: Eran Talmor 2023, the.eran.talmor@gmail.com
 #ifndef _INCLUDE_SCOPED_H_
 #define _INCLUDE_SCOPED_H_
 
+#include <cstddef>
+#include <functional>
+#include <type_traits>
 #include <utility>
 #include <cassert>
 
@@ -20,23 +23,55 @@ namespace scoped
 {
 
 template<class T, class ...Tags> class scoped_shield;
+template<class T, class ...Tags> class scoped_vector;
+
+// A tag for constructing scoped instances at the bottom of their chain, e.g. for defaults that are
+// installed once and are overridden by every other instance.
+struct at_bottom_t {
+    explicit at_bottom_t() = default;
+};
+inline constexpr at_bottom_t at_bottom{};
+
+namespace detail
+{
+
+template<class T> struct type_tag {
+    static constexpr char id = 0;
+};
+
+} // namespace detail
+
+// Returns an identifier of type T, unique in the program. Types are compared by identity, without RTTI.
+// Note: with hidden symbol visibility, each shared library may have its own identifier for a type.
+template<class T> constexpr const void* type_id() {
+    return &detail::type_tag<T>::id;
+}
 
 // An abstract class template for managing resources within a specific scope.
 template <class T, class ...Tags>
 class abstract_scoped {
 public:
     using shield = scoped_shield<T, Tags...>;
+    using abstract = abstract_scoped;
+    using value_type = T;
 
     // Constructor that adds the current instance to the top of the linked list of instances.
-    abstract_scoped() : m_next(nullptr), m_prev(nullptr) {
+    abstract_scoped() : m_next(nullptr), m_prev(nullptr), m_type(nullptr) {
         insert(s_top);
         assert(check_class_invariant());
         assert(check_instance_invariant());
     }
 
+    // Constructor that adds the current instance to the bottom of the linked list of instances.
+    explicit abstract_scoped(at_bottom_t) : m_next(nullptr), m_prev(nullptr), m_type(nullptr) {
+        insert(nullptr);
+        assert(check_class_invariant());
+        assert(check_instance_invariant());
+    }
+
     // Copy constructor that adds the current instance right above the other instance.
     // This helps maintain order stability, e.g. when vector<scoped> is resized.
-    abstract_scoped(const abstract_scoped& other) : m_next(nullptr), m_prev(nullptr) {
+    abstract_scoped(const abstract_scoped& other) : m_next(nullptr), m_prev(nullptr), m_type(other.m_type) {
         insert(const_cast<abstract_scoped*>(&other));
         assert(check_class_invariant());
         assert(check_instance_invariant());
@@ -53,7 +88,8 @@ public:
     }
 
     // Move constructor that replaces the current instance in the linked list of instances.
-    abstract_scoped(abstract_scoped&& other) : m_next(nullptr), m_prev(nullptr) {
+    // Moves only relink pointers, so they never throw, and vector<scoped> moves its elements when it grows.
+    abstract_scoped(abstract_scoped&& other) noexcept : m_next(nullptr), m_prev(nullptr), m_type(other.m_type) {
         insert(&other);
         other.detach();
         assert(check_class_invariant());
@@ -62,7 +98,7 @@ public:
     }
 
     // Move assignment: the instance is already appended. Just detach the other instance.
-    abstract_scoped& operator=(abstract_scoped&& other) {
+    abstract_scoped& operator=(abstract_scoped&& other) noexcept {
         other.detach();
         assert(check_class_invariant());
         assert(check_instance_invariant());
@@ -105,6 +141,33 @@ public:
         return s_bottom;
     }
 
+    // Returns the type_id() of the value of this instance, or nullptr if it is not known.
+    const void* type() const {
+        return m_type;
+    }
+
+    // Returns the value of the innermost instance whose value is exactly of type D, or nullptr. Each
+    // instance is checked by comparing its type, without dynamic_cast.
+    template<class D> static D* find_first() {
+        static_assert(std::is_base_of<T, D>::value || std::is_same<T, D>::value, "D must derive from T");
+        for (abstract_scoped* p = s_top; p; p = p->m_next) {
+            if (p->m_type == type_id<D>()) {
+                return &static_cast<D&>(p->value());
+            }
+        }
+        return nullptr;
+    }
+
+    // Calls f with the value of every instance whose value is exactly of type D, from the top.
+    template<class D, class F> static void for_each_of(F&& f) {
+        static_assert(std::is_base_of<T, D>::value || std::is_same<T, D>::value, "D must derive from T");
+        for (abstract_scoped* p = s_top; p; p = p->m_next) {
+            if (p->m_type == type_id<D>()) {
+                f(static_cast<D&>(p->value()));
+            }
+        }
+    }
+
     // Returns whether or not this instance is attached to the linked list of instances
     bool is_attached() {
         return m_next || m_prev || (s_top == this) || (s_bottom == this);
@@ -116,6 +179,18 @@ public:
     static void* operator new(size_t, void*) = delete;   // placement new
     static void* operator new[](size_t, void*) = delete; // placement array new
 
+protected:
+    struct detached_t {};
+
+    // Constructor that leaves the instance out of the linked list of instances, for containers that link
+    // their elements themselves.
+    explicit abstract_scoped(detached_t) noexcept : m_next(nullptr), m_prev(nullptr), m_type(nullptr) {}
+
+    // Records the type_id() of the value, for scoped classes that know it.
+    void set_type(const void* type) {
+        m_type = type;
+    }
+
 private:
     void insert(abstract_scoped* above) {
         assert(!is_attached());
@@ -155,6 +230,37 @@ private:
         m_next = m_prev = nullptr;
     }
 
+    // Moves the links of a block of n instances, stride bytes apart, to the detached instances at the same
+    // offsets in another block. Links between instances of the block are translated, and only the instances
+    // around it are relinked, so the block keeps its place in the linked list.
+    static void relocate(abstract_scoped* from, abstract_scoped* to, size_t n, size_t stride) noexcept {
+        char* first = reinterpret_cast<char*>(from);
+        char* last = first + n * stride;
+        // Links may point outside the block, so they are compared with std::less, which orders unrelated pointers.
+        std::less<const char*> before;
+        auto translate = [&](abstract_scoped* p) {
+            char* c = reinterpret_cast<char*>(p);
+            return p && !before(c, first) && before(c, last) ? reinterpret_cast<abstract_scoped*>(reinterpret_cast<char*>(to) + (c - first)) : p;
+        };
+        for (size_t i = 0; i < n; ++i) {
+            abstract_scoped* source = reinterpret_cast<abstract_scoped*>(first + i * stride);
+            abstract_scoped* target = reinterpret_cast<abstract_scoped*>(reinterpret_cast<char*>(to) + i * stride);
+            assert(!target->is_attached());
+            target->m_next = translate(source->m_next);
+            target->m_prev = translate(source->m_prev);
+            if (target->m_next && target->m_next == source->m_next) {
+                target->m_next->m_prev = target;
+            }
+            if (target->m_prev && target->m_prev == source->m_prev) {
+                target->m_prev->m_next = target;
+            }
+            source->m_next = source->m_prev = nullptr;
+        }
+        s_top = translate(s_top);
+        s_bottom = translate(s_bottom);
+        assert(to->check_class_invariant());
+    }
+
     // Check that the s_top and s_bottom are either fully detached, or property attached.
     bool check_class_invariant() const {
         assert((!s_top) == (!s_bottom));
@@ -179,11 +285,15 @@ private:
     abstract_scoped* m_next;
     abstract_scoped* m_prev;
 
+    // The type_id() of the value, or nullptr if it is not known.
+    const void* m_type;
+
     // Thread-local storage for the top and bottom instances of the scoped class in the linked list of instances. 
     static thread_local abstract_scoped* s_top;
     static thread_local abstract_scoped* s_bottom;
 
     friend shield;
+    friend class scoped_vector<T, Tags...>;
 };
 
 // Define the thread-local storage for the top and bottom instances of the scoped class in the linked list of instances.
@@ -201,7 +311,16 @@ public:
     // Constructor that initializes the value being scoped with any number of arguments.
     template <class... Args>
     polymorphic_scoped(Args&&... args) : base(), m_value{std::forward<Args>(args)...}
-    {}
+    {
+        this->set_type(type_id<T>());
+    }
+
+    // Constructor that adds the instance to the bottom of the chain.
+    template <class... Args>
+    polymorphic_scoped(at_bottom_t, Args&&... args) : base(at_bottom), m_value{std::forward<Args>(args)...}
+    {
+        this->set_type(type_id<T>());
+    }
     
     // Default contructors, destructor and assignment operators
     polymorphic_scoped(const polymorphic_scoped& other) = default;
@@ -216,6 +335,50 @@ private:
     T m_value;
 };
 
+// A list of base classes, for scoping one value in the chains of all of them with
+// polymorphic_scoped<T, bases<B1, B2, ...>, Tags...>.
+template<class ...Bs> struct bases {};
+
+// A class template for scoping a value of type T in the abstract scopes of each of its base classes Bs.
+// The instance holds the value once, and links one node into every chain.
+template<class T, class ...Bs, class ...Tags>
+class polymorphic_scoped<T, bases<Bs...>, Tags...> : public abstract_scoped<Bs, Tags...>... {
+    static_assert(sizeof...(Bs) > 0, "bases<> must list at least one base class");
+    static_assert((std::is_base_of<Bs, T>::value && ...), "T must derive from all the listed bases");
+
+public:
+    // Constructor that initializes the value being scoped with any number of arguments.
+    template <class... Args>
+    polymorphic_scoped(Args&&... args) : abstract_scoped<Bs, Tags...>()..., m_value{std::forward<Args>(args)...}
+    {
+        (abstract_scoped<Bs, Tags...>::set_type(type_id<T>()), ...);
+    }
+
+    // Constructor that adds the instance to the bottom of the chains.
+    template <class... Args>
+    polymorphic_scoped(at_bottom_t, Args&&... args) :
+        abstract_scoped<Bs, Tags...>(at_bottom)..., m_value{std::forward<Args>(args)...}
+    {
+        (abstract_scoped<Bs, Tags...>::set_type(type_id<T>()), ...);
+    }
+
+    // Default contructors, destructor and assignment operators
+    polymorphic_scoped(const polymorphic_scoped& other) = default;
+    polymorphic_scoped(polymorphic_scoped&& other) = default;
+    ~polymorphic_scoped() = default;
+    polymorphic_scoped& operator=(const polymorphic_scoped& other) = default;
+    polymorphic_scoped& operator=(polymorphic_scoped&& other) = default;
+
+    // Overrides value() of all the bases, with covariant return types.
+    T& value() override { return m_value; }
+
+    // Returns the node of the instance in the chain of base B.
+    template<class B> abstract_scoped<B, Tags...>& node() { return *this; }
+
+private:
+    T m_value;
+};
+
 template<class T, class ...Tags> using scoped = polymorphic_scoped<T, T, Tags...>;
 
 template<class T, class ...Tags> class scoped_shield {
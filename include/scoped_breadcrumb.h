@@ -0,0 +1,130 @@
+/*
+scoped_breadcrumb.h
+
+Lazily formatted error context.
+
+A scoped::breadcrumb describes what the code in its scope is doing ("processing order %d"). Constructing
+one only stores the format string and copies the arguments into inline storage; nothing is formatted and
+nothing is allocated. The breadcrumbs are formatted only when an error handler asks for the trail, by
+walking the chain from the outermost breadcrumb to the innermost one.
+
+Arguments are formatted with printf conversions, so they must be trivially copyable. Strings are
+passed as const char*, and are referred to rather than copied, so they must outlive the breadcrumb. A
+breadcrumb without arguments is taken verbatim.
+
+Since the breadcrumbs of a scope are popped while an exception propagates out of it, the trail should be
+taken at the throw site. breadcrumb_error does that.
+
+Example:
+
+void process(int order_id) {
+    scoped::breadcrumb crumb("processing order %d", order_id);
+    ...
+    if (failed) {
+        throw scoped::breadcrumb_error("payment declined");
+    }
+}
+*/
+
+#ifndef _INCLUDE_SCOPED_BREADCRUMB_H_
+#define _INCLUDE_SCOPED_BREADCRUMB_H_
+
+#include "scoped.h"
+#include <cstdio>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+
+namespace scoped
+{
+
+class breadcrumb : public abstract_scoped<breadcrumb> {
+public:
+    // Bytes of inline storage for the arguments.
+    static constexpr size_t capacity = 48;
+
+    template<class... Args>
+    explicit breadcrumb(const char* format, const Args&... args) : m_format(format), m_formatter(&format_args<std::decay_t<const Args>...>) {
+        // Arrays, such as string literals, are stored as pointers.
+        using stored = std::tuple<std::decay_t<const Args>...>;
+        static_assert(std::conjunction<std::is_trivially_copyable<std::decay_t<const Args>>...>::value,
+                      "breadcrumb arguments must be trivially copyable");
+        static_assert(std::is_trivially_destructible<stored>::value, "breadcrumb arguments must be trivially destructible");
+        static_assert(sizeof(stored) <= capacity, "breadcrumb arguments do not fit in the inline storage");
+        static_assert(alignof(stored) <= alignof(max_align_t), "breadcrumb arguments are over-aligned");
+        ::new (static_cast<void*>(m_args)) stored(args...);
+    }
+
+    breadcrumb(const breadcrumb&) = delete;
+    breadcrumb& operator=(const breadcrumb&) = delete;
+
+    breadcrumb& value() override { return *this; }
+
+    // Formats this breadcrumb.
+    std::string str() const {
+        std::string out;
+        append_to(out);
+        return out;
+    }
+
+    // Appends this breadcrumb, formatted, to out.
+    void append_to(std::string& out) const {
+        m_formatter(m_format, m_args, out);
+    }
+
+    // Formats the breadcrumbs of the calling thread, from the outermost to the innermost one.
+    static std::string trail(const char* separator = " > ") {
+        std::string out;
+        for (auto crumb = abstract::bottom(); crumb; crumb = crumb->prev()) {
+            if (crumb != abstract::bottom()) {
+                out += separator;
+            }
+            crumb->value().append_to(out);
+        }
+        return out;
+    }
+
+private:
+    template<class... Args>
+    static void format_args(const char* format, const void* storage, std::string& out) {
+        if constexpr (sizeof...(Args) == 0) {
+            out += format;
+        }
+        else {
+            auto& args = *static_cast<const std::tuple<Args...>*>(storage);
+            std::apply([&](const Args&... a) {
+                int length = std::snprintf(nullptr, 0, format, a...);
+                if (length <= 0) return;
+                size_t offset = out.size();
+                out.resize(offset + size_t(length) + 1);
+                std::snprintf(&out[offset], size_t(length) + 1, format, a...);
+                out.resize(offset + size_t(length));
+            }, args);
+        }
+    }
+
+    const char* m_format;
+    void (*m_formatter)(const char*, const void*, std::string&);
+    alignas(max_align_t) unsigned char m_args[capacity];
+};
+
+// An exception whose message ends with the breadcrumb trail at the point where it was constructed.
+class breadcrumb_error : public std::runtime_error {
+public:
+    explicit breadcrumb_error(const std::string& what) : breadcrumb_error(what, breadcrumb::trail()) {}
+
+    // Returns the breadcrumb trail at the point where the exception was constructed.
+    const std::string& trail() const { return m_trail; }
+
+private:
+    breadcrumb_error(const std::string& what, std::string trail) :
+        std::runtime_error(trail.empty() ? what : what + " (" + trail + ")"), m_trail(std::move(trail)) {}
+
+    std::string m_trail;
+};
+
+} // namespace scoped
+
+#endif // _INCLUDE_SCOPED_BREADCRUMB_H_
@@ -0,0 +1,464 @@
+/*
+scoped_config.h
+
+Loads configuration defaults into scoped values from a compact, memory-mapped binary file.
+
+Configuration text has one "key = value" per line; empty lines and lines starting with # are ignored.
+Values are booleans (true, false), integers, reals, or strings (quoted with ", or any other text).
+compile_config() (and the scoped_config_compile tool) converts the text to the binary format: a header,
+the entries sorted by key, and the keys and string values, NUL-terminated.
+
+A config_file maps a binary file and looks keys up by binary search, without parsing or allocating.
+Scoped types are bound to keys with config_file::bind<S>(key). install() then constructs, for every bound
+key present in the file, an instance of S at the bottom of its chain on the calling thread, so that the
+configured value is the default that every other instance in the program overrides. String values are
+std::string_view or const char* pointing into the mapping; numbers and booleans are converted to the
+bound arithmetic type. All the instances are constructed in one block of memory, so installing does not
+allocate per value.
+
+The mapping must outlive the installed defaults, and the defaults are installed on the calling thread
+only. Other threads see them by installing a scoped::context captured on that thread, if S is
+registered with context::propagate<S>().
+
+Example:
+
+using Timeout = scoped::scoped<int, struct TimeoutTag>;
+using Region = scoped::scoped<std::string_view, struct RegionTag>;
+static const bool timeout_bound = scoped::config_file::bind<Timeout>("net.timeout_ms");
+static const bool region_bound = scoped::config_file::bind<Region>("region");
+
+int main() {
+    scoped::config_file config("service.scfg");      // Compiled by scoped_config_compile
+    auto defaults = config.install();
+    ...
+}
+*/
+
+#ifndef _INCLUDE_SCOPED_CONFIG_H_
+#define _INCLUDE_SCOPED_CONFIG_H_
+
+#include "scoped.h"
+#include "scoped_context.h"
+#include "scoped_mmap.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace scoped
+{
+
+class config_error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+enum class config_type : uint32_t {
+    boolean = 1,
+    integer = 2,
+    real = 3,
+    string = 4
+};
+
+// A configuration value. Strings refer to the text or the mapping they were read from.
+struct config_value {
+    config_type type;
+    bool boolean;
+    int64_t integer;
+    double real;
+    std::string_view string;
+};
+
+namespace detail
+{
+
+inline std::string_view trim(std::string_view text) {
+    size_t first = text.find_first_not_of(" \t\r");
+    if (first == std::string_view::npos) return {};
+    size_t last = text.find_last_not_of(" \t\r");
+    return text.substr(first, last - first + 1);
+}
+
+// The layout of the binary format. All offsets are from the start of the file.
+struct config_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+struct config_entry {
+    uint32_t key_offset;
+    uint32_t key_size;
+    uint32_t type;
+    uint32_t string_size;
+    union {
+        int64_t integer;
+        double real;
+        uint64_t string_offset;
+    };
+};
+
+static_assert(sizeof(config_entry) == 24, "config_entry must have the same layout everywhere");
+
+constexpr char config_magic[4] = {'S', 'C', 'F', 'G'};
+constexpr uint32_t config_version = 1;
+
+} // namespace detail
+
+// Calls on_entry(key, value) for every line of the configuration text, in order. Quoted strings are
+// unescaped into storage, which must outlive their use. Throws a config_error on malformed lines.
+template<class F> void parse_config(std::string_view text, std::deque<std::string>& storage, F&& on_entry) {
+    size_t line_number = 0;
+    while (!text.empty()) {
+        ++line_number;
+        size_t end = text.find('\n');
+        std::string_view line = detail::trim(text.substr(0, end));
+        text = end == std::string_view::npos ? std::string_view() : text.substr(end + 1);
+        if (line.empty() || line[0] == '#') continue;
+
+        size_t equals = line.find('=');
+        std::string_view key = detail::trim(line.substr(0, equals));
+        if (equals == std::string_view::npos || key.empty()) {
+            throw config_error("line " + std::to_string(line_number) + ": expected key = value");
+        }
+        std::string_view raw = detail::trim(line.substr(equals + 1));
+        config_value value = {config_type::string, false, 0, 0.0, raw};
+        if (raw.size() >= 2 && raw.front() == '"' && raw.back() == '"') {
+            std::string unescaped;
+            for (size_t i = 1; i + 1 < raw.size(); ++i) {
+                char c = raw[i];
+                if (c == '\\' && i + 2 < raw.size()) {
+                    c = raw[++i];
+                    c = c == 'n' ? '\n' : c == 't' ? '\t' : c;
+                }
+                unescaped += c;
+            }
+            storage.push_back(std::move(unescaped));
+            value.string = storage.back();
+        }
+        else if (raw == "true" || raw == "false") {
+            value.type = config_type::boolean;
+            value.boolean = raw == "true";
+        }
+        else if (!raw.empty()) {
+            std::string number(raw);
+            char* parsed_end;
+            errno = 0;
+            long long integer = std::strtoll(number.c_str(), &parsed_end, 10);
+            if (*parsed_end == '\0' && errno == 0) {
+                value.type = config_type::integer;
+                value.integer = integer;
+            }
+            else {
+                double real = std::strtod(number.c_str(), &parsed_end);
+                if (*parsed_end == '\0') {
+                    value.type = config_type::real;
+                    value.real = real;
+                }
+            }
+        }
+        on_entry(key, value);
+    }
+}
+
+// Converts configuration text to the binary format. Later lines override earlier lines with the same key.
+inline std::string compile_config(std::string_view text) {
+    std::deque<std::string> storage;
+    std::map<std::string_view, config_value> entries;
+    parse_config(text, storage, [&entries](std::string_view key, const config_value& value) {
+        entries[key] = value;
+    });
+
+    std::string pool;
+    size_t pool_offset = sizeof(detail::config_header) + entries.size() * sizeof(detail::config_entry);
+    auto add_string = [&pool, pool_offset](std::string_view s) {
+        size_t offset = pool_offset + pool.size();
+        pool.append(s.data(), s.size());
+        pool += '\0';
+        return offset;
+    };
+
+    std::vector<detail::config_entry> table;
+    for (auto& item : entries) {
+        detail::config_entry entry;
+        std::memset(&entry, 0, sizeof(entry));
+        entry.key_offset = uint32_t(add_string(item.first));
+        entry.key_size = uint32_t(item.first.size());
+        entry.type = uint32_t(item.second.type);
+        switch (item.second.type) {
+        case config_type::boolean: entry.integer = item.second.boolean; break;
+        case config_type::integer: entry.integer = item.second.integer; break;
+        case config_type::real: entry.real = item.second.real; break;
+        case config_type::string:
+            entry.string_offset = add_string(item.second.string);
+            entry.string_size = uint32_t(item.second.string.size());
+            break;
+        }
+        table.push_back(entry);
+    }
+    if (pool_offset + pool.size() > UINT32_MAX) {
+        throw config_error("configuration too large");
+    }
+
+    detail::config_header header;
+    std::memcpy(header.magic, detail::config_magic, sizeof(header.magic));
+    header.version = detail::config_version;
+    header.count = uint32_t(table.size());
+    header.reserved = 0;
+
+    std::string binary(reinterpret_cast<const char*>(&header), sizeof(header));
+    binary.append(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(detail::config_entry));
+    binary += pool;
+    return binary;
+}
+
+class config_file {
+public:
+    // Maps the binary configuration file at path. Throws a config_error if it is not valid.
+    explicit config_file(const std::string& path) : m_entries(nullptr), m_count(0) {
+        auto mapping = detail::map_file(path, false, true);
+        m_data = static_cast<const char*>(mapping.first);
+        m_size = mapping.second;
+        try {
+            validate();
+        }
+        catch (...) {
+            unmap();
+            throw;
+        }
+    }
+
+    config_file(const config_file&) = delete;
+    config_file& operator=(const config_file&) = delete;
+
+    ~config_file() {
+        unmap();
+    }
+
+    size_t size() const { return m_count; }
+
+    // Looks key up. Returns false if it is not in the file.
+    bool find(std::string_view key, config_value& value) const {
+        const detail::config_entry* first = m_entries;
+        const detail::config_entry* last = m_entries + m_count;
+        auto it = std::lower_bound(first, last, key, [this](const detail::config_entry& e, std::string_view k) {
+            return key_of(e) < k;
+        });
+        if (it == last || key_of(*it) != key) return false;
+        value = value_of(*it);
+        return true;
+    }
+
+    // Binds the scoped type S to key, so that install() constructs an S with its value. S must be
+    // constructible from at_bottom and a value of S::value_type, which is a string view, a C string, a
+    // std::string, or an arithmetic type. Returns true, so that it can initialize a static variable.
+    template<class S> static bool bind(const char* key) {
+        using V = std::remove_cv_t<typename S::value_type>;
+        binding b;
+        b.key = key;
+        b.node_size = sizeof(S);
+        b.node_align = alignof(S);
+        b.construct = [](void* where, const config_value& value) {
+            V converted;
+            if (!convert(value, converted)) return false;
+            ::new (where) S(at_bottom, std::move(converted));
+            return true;
+        };
+        b.destroy = [](void* node) {
+            static_cast<S*>(node)->~S();
+        };
+        std::lock_guard<std::mutex> lock(bindings_mutex());
+        bindings().push_back(b);
+        return true;
+    }
+
+    // Scoped instances of the bound types, at the bottom of their chains, for their lifetime.
+    class defaults {
+    public:
+        explicit defaults(const config_file& file) {
+            std::lock_guard<std::mutex> lock(bindings_mutex());
+            auto& all = bindings();
+            size_t bytes = 0;
+            for (auto& b : all) {
+                block::place(bytes, b.node_size, b.node_align);
+            }
+            m_storage.allocate(bytes);
+            m_nodes.reserve(all.size());
+            size_t end = 0;
+            config_value value;
+            try {
+                for (auto& b : all) {
+                    void* node = m_storage.at(block::place(end, b.node_size, b.node_align));
+                    if (file.find(b.key, value)) {
+                        if (!b.construct(node, value)) {
+                            throw config_error(std::string("unexpected type for ") + b.key);
+                        }
+                        m_nodes.push_back({b.destroy, node});
+                    }
+                }
+            }
+            catch (...) {
+                // Unlink the instances already constructed, before their storage is freed.
+                clear();
+                throw;
+            }
+        }
+
+        defaults(const defaults&) = delete;
+        defaults& operator=(const defaults&) = delete;
+
+        ~defaults() {
+            clear();
+        }
+
+        // The number of instances installed.
+        size_t size() const { return m_nodes.size(); }
+
+    private:
+        void clear() {
+            for (size_t i = m_nodes.size(); i-- > 0;) {
+                m_nodes[i].destroy(m_nodes[i].node);
+            }
+            m_nodes.clear();
+        }
+
+        struct node {
+            void (*destroy)(void*);
+            void* node;
+        };
+
+        using block = detail::node_block<256>;
+
+        block m_storage;
+        std::vector<node> m_nodes;
+    };
+
+    // Installs the values of the bound keys on the calling thread, for the lifetime of the returned object.
+    defaults install() const { return defaults(*this); }
+
+private:
+    struct binding {
+        const char* key;
+        size_t node_size;
+        size_t node_align;
+        bool (*construct)(void* where, const config_value& value);
+        void (*destroy)(void* node);
+    };
+
+    static std::vector<binding>& bindings() {
+        static std::vector<binding> s_bindings;
+        return s_bindings;
+    }
+
+    static std::mutex& bindings_mutex() {
+        static std::mutex s_mutex;
+        return s_mutex;
+    }
+
+    // Converts a value to the bound type. Returns false if the types do not match.
+    template<class V> static bool convert(const config_value& value, V& to) {
+        if constexpr (std::is_same<V, std::string_view>::value || std::is_same<V, std::string>::value) {
+            if (value.type != config_type::string) return false;
+            to = V(value.string.data(), value.string.size());
+        }
+        else if constexpr (std::is_same<V, const char*>::value) {
+            if (value.type != config_type::string) return false;
+            to = value.string.data();
+        }
+        else if constexpr (std::is_same<V, bool>::value) {
+            if (value.type != config_type::boolean) return false;
+            to = value.boolean;
+        }
+        else if constexpr (std::is_integral<V>::value) {
+            if (value.type != config_type::integer) return false;
+            // Integers that do not fit in V are a mismatch too, rather than truncated.
+            using limits = std::numeric_limits<V>;
+            if (value.integer < 0 ? value.integer < int64_t(limits::min()) : uint64_t(value.integer) > uint64_t(limits::max())) {
+                return false;
+            }
+            to = V(value.integer);
+        }
+        else if constexpr (std::is_floating_point<V>::value) {
+            if (value.type == config_type::real) to = V(value.real);
+            else if (value.type == config_type::integer) to = V(value.integer);
+            else return false;
+        }
+        else {
+            static_assert(std::is_arithmetic<V>::value, "unsupported configuration value type");
+        }
+        return true;
+    }
+
+    void validate() {
+        if (m_size < sizeof(detail::config_header)) {
+            throw config_error("configuration file too short");
+        }
+        auto header = reinterpret_cast<const detail::config_header*>(m_data);
+        if (std::memcmp(header->magic, detail::config_magic, sizeof(header->magic)) != 0 ||
+            header->version != detail::config_version) {
+            throw config_error("not a compiled configuration file");
+        }
+        if ((m_size - sizeof(*header)) / sizeof(detail::config_entry) < header->count) {
+            throw config_error("configuration file truncated");
+        }
+        m_entries = reinterpret_cast<const detail::config_entry*>(m_data + sizeof(*header));
+        m_count = header->count;
+        for (size_t i = 0; i < m_count; ++i) {
+            const detail::config_entry& e = m_entries[i];
+            bool is_string = e.type == uint32_t(config_type::string);
+            if (!in_bounds(e.key_offset, e.key_size) || (is_string && !in_bounds(e.string_offset, e.string_size)) ||
+                e.type < uint32_t(config_type::boolean) || e.type > uint32_t(config_type::string) ||
+                (i && key_of(m_entries[i - 1]) >= key_of(e))) {
+                throw config_error("corrupt configuration file");
+            }
+        }
+    }
+
+    // Returns whether a NUL-terminated string of size bytes at offset is within the file.
+    bool in_bounds(uint64_t offset, uint64_t size) const {
+        return offset < m_size && size < m_size - offset && m_data[offset + size] == '\0';
+    }
+
+    std::string_view key_of(const detail::config_entry& e) const {
+        return std::string_view(m_data + e.key_offset, e.key_size);
+    }
+
+    config_value value_of(const detail::config_entry& e) const {
+        config_value value = {config_type(e.type), false, 0, 0.0, {}};
+        switch (value.type) {
+        case config_type::boolean: value.boolean = e.integer != 0; break;
+        case config_type::integer: value.integer = e.integer; break;
+        case config_type::real: value.real = e.real; break;
+        case config_type::string: value.string = std::string_view(m_data + e.string_offset, e.string_size); break;
+        }
+        return value;
+    }
+
+    void unmap() {
+        if (m_size) {
+            ::munmap(const_cast<char*>(m_data), m_size);
+        }
+        m_size = 0;
+    }
+
+    const char* m_data;
+    size_t m_size;
+    const detail::config_entry* m_entries;
+    size_t m_count;
+};
+
+} // namespace scoped
+
+#endif // _INCLUDE_SCOPED_CONFIG_H_
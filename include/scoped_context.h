@@ -0,0 +1,519 @@
+/*
+scoped_context.h
+
+Carries scoped values across threads.
+
+The chains of scoped<T> instances are thread-local, so a task handed to another thread does not see the
+values that were scoped when it was created. A scoped::context is a snapshot of the top() instance of
+every registered chain. Installing it on another thread pushes, for every captured chain, a node that
+refers to the captured instance, and pops these nodes again when the returned guard is destroyed. The
+values are only read when the receiving thread reads them.
+
+Chains take part in capturing once they are registered with context::propagate<S>(), where S is a
+scoped<>, polymorphic_scoped<> or abstract_scoped<> type. The captured instances are referred to, not
+copied, so they must outlive the tasks that use them.
+
+A scoped::detached_context holds copies of the captured values instead, for the values that can be
+copied, so that it can be installed after their scopes exit. scoped::bind(f) captures one, and returns a
+callable that installs it around every call to f. It suits callbacks registered during a request and
+invoked later by an event loop. Small captures are stored in the callable without allocating.
+
+Example:
+
+using ScopedTenant = scoped::scoped<std::string, struct TenantTag>;
+static const bool tenant_propagated = scoped::context::propagate<ScopedTenant>();
+
+void handle_request() {
+    ScopedTenant tenant("acme");
+    auto ctx = scoped::context::capture();
+    std::thread worker([&ctx] {
+        auto guard = ctx.install();
+        assert(ScopedTenant::top()->value() == "acme");
+    });
+    worker.join();
+}
+*/
+
+#ifndef _INCLUDE_SCOPED_CONTEXT_H_
+#define _INCLUDE_SCOPED_CONTEXT_H_
+
+#include "scoped.h"
+#include <atomic>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace scoped
+{
+
+namespace detail
+{
+
+// A vector of trivially copyable items, the first N of which are stored inline.
+template<class T, size_t N> class small_vector {
+public:
+    void push_back(const T& item) {
+        if (m_size < N) {
+            m_inline[m_size] = item;
+        }
+        else {
+            m_more.push_back(item);
+        }
+        ++m_size;
+    }
+
+    size_t size() const { return m_size; }
+
+    T& operator[](size_t i) { return i < N ? m_inline[i] : m_more[i - N]; }
+    const T& operator[](size_t i) const { return i < N ? m_inline[i] : m_more[i - N]; }
+
+private:
+    T m_inline[N];
+    std::vector<T> m_more;
+    size_t m_size = 0;
+};
+
+// Storage for objects of various sizes and alignments laid out one after the other, e.g. the scoped
+// nodes pushed by a guard. Layouts of up to Inline bytes are stored in the block itself, without
+// allocating.
+template<size_t Inline> class node_block {
+public:
+    node_block() : m_data(m_inline) {}
+
+    node_block(const node_block&) = delete;
+    node_block& operator=(const node_block&) = delete;
+
+    // Adds an object of the given size and alignment at the end of a layout of end bytes. Returns the
+    // offset of the object.
+    static size_t place(size_t& end, size_t size, size_t align) {
+        size_t offset = (end + align - 1) / align * align;
+        end = offset + size;
+        return offset;
+    }
+
+    // Makes room for a layout of size bytes, discarding the previous storage.
+    void allocate(size_t size) {
+        if (size > Inline) {
+            m_heap.reset(new max_align_t[(size + sizeof(max_align_t) - 1) / sizeof(max_align_t)]);
+            m_data = reinterpret_cast<unsigned char*>(m_heap.get());
+        }
+        else {
+            m_heap.reset();
+            m_data = m_inline;
+        }
+    }
+
+    // Takes the allocated storage of other, which is left empty. Returns false, changing nothing, if
+    // the layout of other is stored inline.
+    bool take(node_block& other) {
+        if (!other.m_heap) return false;
+        m_heap = std::move(other.m_heap);
+        m_data = reinterpret_cast<unsigned char*>(m_heap.get());
+        other.m_data = other.m_inline;
+        return true;
+    }
+
+    // The object at offset in the layout.
+    void* at(size_t offset) { return m_data + offset; }
+
+private:
+    alignas(max_align_t) unsigned char m_inline[Inline];
+    unsigned char* m_data;
+    std::unique_ptr<max_align_t[]> m_heap;
+};
+
+} // namespace detail
+
+// The node pushed for a captured chain on the thread that installs a context. It exposes the value of
+// the instance captured on the originating thread, which is only read when the value is, so that a
+// scoped::lazy value is not built for tasks that never read it. It has the type_id() of the captured
+// instance, so that find_first() and for_each_of() find it.
+template<class A> class borrowed_scoped : public A {
+public:
+    using value_type = typename A::value_type;
+
+    explicit borrowed_scoped(A& source) : m_source(&source) {
+        this->set_type(source.type());
+    }
+
+    borrowed_scoped(const borrowed_scoped&) = delete;
+    borrowed_scoped& operator=(const borrowed_scoped&) = delete;
+
+    value_type& value() override { return m_source->value(); }
+
+private:
+    A* m_source;
+};
+
+namespace detail
+{
+
+// A copy of a captured value, held by a detached_context. It is an instance of the chain that is
+// never linked, so that it is captured and installed like the instance it was copied from.
+template<class A> class copied_scoped : public A {
+public:
+    using value_type = typename A::value_type;
+
+    template<class V> copied_scoped(V&& value, const void* type) :
+        A(typename A::detached_t()), m_value(std::forward<V>(value)) {
+        this->set_type(type);
+    }
+
+    copied_scoped(const copied_scoped&) = delete;
+    copied_scoped& operator=(const copied_scoped&) = delete;
+
+    value_type& value() override { return m_value; }
+
+private:
+    value_type m_value;
+};
+
+} // namespace detail
+
+// Selects the node type pushed when a context holding a chain of type A is installed. The node is
+// constructed from the captured instance if it accepts one, and from a reference to its value
+// otherwise. Specialize it for chains that have to do more than expose the value on the receiving
+// thread.
+template<class A> struct borrow_traits {
+    using node = borrowed_scoped<A>;
+};
+
+class context {
+public:
+    // How to capture and install one registered chain.
+    struct chain {
+        // The top instance, or nullptr.
+        void* (*top)();
+        void (*construct)(void* where, void* instance);
+        void (*destroy)(void* node);
+        size_t node_size;
+        size_t node_align;
+        // Copy the value of an instance into a detached instance, for values that are copy
+        // constructible and not polymorphic; null otherwise.
+        void (*copy)(void* where, void* instance);
+        // Move a detached instance made by copy.
+        void (*move)(void* where, void* copy);
+        void (*destroy_copy)(void* copy);
+        size_t copy_size;
+        size_t copy_align;
+    };
+
+    // Most contexts hold a handful of chains, which are stored without allocating.
+    static constexpr size_t max_inline = 4;
+
+    // A captured chain and its top instance, or a node pushed by a guard.
+    struct captured {
+        const chain* source;
+        void* instance;
+    };
+
+    // Registers the chain of S to be captured by capture(). Registering a chain more than once, e.g. as
+    // both scoped<T> and abstract_scoped<T>, has no effect. Returns true, so that it can initialize a
+    // static variable. Throws std::length_error if more than max_chains chains are registered.
+    template<class S> static bool propagate() {
+        return registration<typename S::abstract>::add();
+    }
+
+    // An empty context, installing nothing.
+    context() = default;
+
+    // Captures the top instance of every registered chain on the calling thread. Their values are not
+    // read until they are read on a thread that installs the context.
+    static context capture() {
+        context ctx;
+        auto& reg = registry();
+        size_t count = reg.count.load(std::memory_order_acquire);
+        for (size_t i = 0; i < count; ++i) {
+            if (void* instance = reg.chains[i].top()) {
+                ctx.m_captured.push_back({&reg.chains[i], instance});
+            }
+        }
+        return ctx;
+    }
+
+    // Returns whether no chain had a value when the context was captured.
+    bool empty() const { return m_captured.size() == 0; }
+
+    // Pushes the captured values on the calling thread for the lifetime of the guard. Guards must be
+    // destroyed on the thread that created them, in reverse order of their creation.
+    class guard {
+    public:
+        explicit guard(const context& ctx) {
+            size_t bytes = 0;
+            for (size_t i = 0; i < ctx.m_captured.size(); ++i) {
+                const chain* c = ctx.m_captured[i].source;
+                block::place(bytes, c->node_size, c->node_align);
+            }
+            m_nodes.allocate(bytes);
+            size_t end = 0;
+            for (size_t i = 0; i < ctx.m_captured.size(); ++i) {
+                const captured& item = ctx.m_captured[i];
+                size_t offset = block::place(end, item.source->node_size, item.source->node_align);
+                // Installing on the capturing thread itself (e.g. when a task runs inline) pushes nothing.
+                if (item.source->top() != item.instance) {
+                    void* node = m_nodes.at(offset);
+                    item.source->construct(node, item.instance);
+                    m_pushed.push_back({item.source, node});
+                }
+            }
+        }
+
+        guard(const guard&) = delete;
+        guard& operator=(const guard&) = delete;
+
+        ~guard() {
+            for (size_t i = m_pushed.size(); i-- > 0;) {
+                m_pushed[i].source->destroy(m_pushed[i].instance);
+            }
+        }
+
+    private:
+        // Room for max_inline borrowed_scoped nodes: a vtable pointer, two links, a type id and a source
+        // pointer each.
+        using block = detail::node_block<max_inline * 5 * sizeof(void*)>;
+
+        block m_nodes;
+        detail::small_vector<captured, max_inline> m_pushed;
+    };
+
+    // Installs the context for the lifetime of the returned guard.
+    guard install() const { return guard(*this); }
+
+    // Calls f() with the context installed.
+    template<class F> decltype(auto) run(F&& f) const {
+        guard g(*this);
+        return std::forward<F>(f)();
+    }
+
+private:
+    friend class detached_context;
+
+    static constexpr size_t max_chains = 64;
+
+    template<class A, class V = typename A::value_type,
+             bool = std::is_copy_constructible<V>::value && !std::is_polymorphic<V>::value>
+    struct copier {
+        static constexpr void (*copy)(void*, void*) = nullptr;
+        static constexpr void (*move)(void*, void*) = nullptr;
+        static constexpr void (*destroy)(void*) = nullptr;
+        static constexpr size_t size = 0;
+        static constexpr size_t align = 1;
+    };
+
+    template<class A, class V> struct copier<A, V, true> {
+        using copy_type = detail::copied_scoped<A>;
+
+        static void copy(void* where, void* instance) {
+            A& source = *static_cast<A*>(instance);
+            ::new (where) copy_type(source.value(), source.type());
+        }
+
+        static void move(void* where, void* copy) {
+            copy_type& source = *static_cast<copy_type*>(copy);
+            ::new (where) copy_type(std::move(source.value()), source.type());
+        }
+
+        static void destroy(void* copy) { static_cast<copy_type*>(copy)->~copy_type(); }
+
+        static constexpr size_t size = sizeof(copy_type);
+        static constexpr size_t align = alignof(copy_type);
+    };
+
+    // Registers the chain A once, however many scoped types of the chain are propagated.
+    template<class A> struct registration {
+        static bool add() {
+            using node = typename borrow_traits<A>::node;
+            static const bool s_registered = add_chain({
+                []() -> void* {
+                    return A::top();
+                },
+                [](void* where, void* instance) {
+                    A& source = *static_cast<A*>(instance);
+                    if constexpr (std::is_constructible<node, A&>::value) {
+                        ::new (where) node(source);
+                    }
+                    else {
+                        ::new (where) node(source.value());
+                    }
+                },
+                [](void* n) {
+                    static_cast<node*>(n)->~node();
+                },
+                sizeof(node),
+                alignof(node),
+                copier<A>::copy,
+                copier<A>::move,
+                copier<A>::destroy,
+                copier<A>::size,
+                copier<A>::align
+            });
+            return s_registered;
+        }
+    };
+
+    struct chain_registry {
+        chain chains[max_chains];
+        std::atomic<size_t> count{0};
+    };
+
+    static chain_registry& registry() {
+        static chain_registry s_registry;
+        return s_registry;
+    }
+
+    // Called once per chain type, from the initialization of a function-local static.
+    static bool add_chain(const chain& c) {
+        static std::atomic_flag s_lock = ATOMIC_FLAG_INIT;
+        auto& reg = registry();
+        while (s_lock.test_and_set(std::memory_order_acquire));
+        size_t count = reg.count.load(std::memory_order_relaxed);
+        if (count == max_chains) {
+            s_lock.clear(std::memory_order_release);
+            throw std::length_error("too many chains registered with scoped::context");
+        }
+        reg.chains[count] = c;
+        reg.count.store(count + 1, std::memory_order_release);
+        s_lock.clear(std::memory_order_release);
+        return true;
+    }
+
+    detail::small_vector<captured, max_inline> m_captured;
+};
+
+// A context that holds copies of the captured values, so that it can be installed after their scopes
+// exit. Values that are not copyable (or polymorphic) are referred to, as by context. Each copy is held
+// by an unlinked instance of its chain, four pointers larger than the value, and up to inline_size bytes
+// of them are stored without allocating. Copying reads the values, so a scoped::lazy value is built
+// when a detached_context captures it.
+class detached_context {
+public:
+    static constexpr size_t inline_size = 128;
+
+    detached_context() {}
+
+    detached_context(const detached_context& other) : detached_context() {
+        copy_from(other.m_context);
+    }
+
+    // Takes the copies of other, which is left empty. Copies stored on the heap are not moved.
+    detached_context(detached_context&& other) : detached_context() {
+        if (m_values.take(other.m_values)) {
+            m_context = other.m_context;
+            other.m_context = context();
+        }
+        else {
+            copy_from(other.m_context, true);
+            other.clear();
+        }
+    }
+
+    detached_context& operator=(const detached_context& other) {
+        if (this != &other) {
+            clear();
+            copy_from(other.m_context);
+        }
+        return *this;
+    }
+
+    ~detached_context() {
+        clear();
+    }
+
+    // Captures copies of the current values of the registered chains on the calling thread.
+    static detached_context capture() {
+        detached_context ctx;
+        ctx.copy_from(context::capture());
+        return ctx;
+    }
+
+    bool empty() const { return m_context.empty(); }
+
+    context::guard install() const { return m_context.install(); }
+
+    // The context referring to the copies, valid as long as this object.
+    const context& get() const { return m_context; }
+
+private:
+    using block = detail::node_block<inline_size>;
+
+    // Copies the copyable values of from, or moves them if move is true.
+    void copy_from(const context& from, bool move = false) {
+        size_t bytes = 0;
+        for (size_t i = 0; i < from.m_captured.size(); ++i) {
+            const context::chain* c = from.m_captured[i].source;
+            if (c->copy) {
+                block::place(bytes, c->copy_size, c->copy_align);
+            }
+        }
+        m_values.allocate(bytes);
+        size_t end = 0;
+        for (size_t i = 0; i < from.m_captured.size(); ++i) {
+            context::captured item = from.m_captured[i];
+            if (item.source->copy) {
+                void* copy = m_values.at(block::place(end, item.source->copy_size, item.source->copy_align));
+                if (move) {
+                    item.source->move(copy, item.instance);
+                }
+                else {
+                    item.source->copy(copy, item.instance);
+                }
+                item.instance = copy;
+            }
+            m_context.m_captured.push_back(item);
+        }
+    }
+
+    void clear() {
+        for (size_t i = 0; i < m_context.m_captured.size(); ++i) {
+            const context::captured& item = m_context.m_captured[i];
+            if (item.source->copy) {
+                item.source->destroy_copy(item.instance);
+            }
+        }
+        m_context = context();
+        m_values.allocate(0);
+    }
+
+    context m_context;
+    block m_values;
+};
+
+// A callable that calls F with the context captured by bind() installed.
+template<class F> class bound_function {
+public:
+    bound_function(F fn, detached_context ctx) : m_fn(std::move(fn)), m_context(std::move(ctx)) {}
+
+    template<class... Args> decltype(auto) operator()(Args&&... args) {
+        if (m_context.empty()) {
+            return m_fn(std::forward<Args>(args)...);
+        }
+        context::guard g(m_context.get());
+        return m_fn(std::forward<Args>(args)...);
+    }
+
+    template<class... Args> decltype(auto) operator()(Args&&... args) const {
+        if (m_context.empty()) {
+            return m_fn(std::forward<Args>(args)...);
+        }
+        context::guard g(m_context.get());
+        return m_fn(std::forward<Args>(args)...);
+    }
+
+    const detached_context& bound_context() const { return m_context; }
+
+private:
+    F m_fn;
+    detached_context m_context;
+};
+
+// Returns a callable that calls fn with copies of the calling thread's scoped values installed.
+template<class F> bound_function<std::decay_t<F>> bind(F&& fn) {
+    return bound_function<std::decay_t<F>>(std::forward<F>(fn), detached_context::capture());
+}
+
+} // namespace scoped
+
+#endif // _INCLUDE_SCOPED_CONTEXT_H_
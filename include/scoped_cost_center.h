@@ -0,0 +1,148 @@
+/*
+scoped_cost_center.h
+
+Per-tenant CPU time accounting.
+
+A scoped::cost_center charges the CPU time of its thread (CLOCK_THREAD_CPUTIME_ID) to a cost_account
+for as long as it is the innermost cost center. The clock is sampled only when the innermost cost center
+changes: when one is pushed or popped, and when a captured scoped::context is installed on or removed
+from a thread. Charges are collected in the cost center itself, and flushed to the account's global total
+with a single atomic add when the cost center is popped, or once the pending charge exceeds
+flush_threshold_ns.
+
+The cost center chain is registered with scoped::context, so work that carries a captured context onto
+a worker thread keeps being charged to the same account while it runs there.
+
+Example:
+
+scoped::cost_account acme("acme");
+
+void handle_request() {
+    scoped::cost_center billing(acme);
+    ...
+    pool.submit([ctx = scoped::context::capture()] {
+        auto guard = ctx.install();    // Charged to acme as well
+        ...
+    });
+}
+*/
+
+#ifndef _INCLUDE_SCOPED_COST_CENTER_H_
+#define _INCLUDE_SCOPED_COST_CENTER_H_
+
+#include "scoped_context.h"
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <string>
+
+namespace scoped
+{
+
+// An account CPU time is charged to, e.g. one per tenant. The account must outlive the cost centers
+// charging it.
+class cost_account {
+public:
+    explicit cost_account(std::string name) : m_name(std::move(name)), m_cpu_ns(0) {}
+
+    cost_account(const cost_account&) = delete;
+    cost_account& operator=(const cost_account&) = delete;
+
+    const std::string& name() const { return m_name; }
+
+    // Returns the CPU time flushed to the account so far, in nanoseconds.
+    uint64_t cpu_ns() const { return m_cpu_ns.load(std::memory_order_relaxed); }
+
+    void charge(uint64_t ns) { m_cpu_ns.fetch_add(ns, std::memory_order_relaxed); }
+
+private:
+    std::string m_name;
+    std::atomic<uint64_t> m_cpu_ns;
+};
+
+namespace detail
+{
+struct cost_center_tag;
+}
+
+// Charges the CPU time of the current thread to an account while it is the innermost cost center.
+class cost_center : public abstract_scoped<cost_account, detail::cost_center_tag> {
+public:
+    // Pending charges above this are flushed without waiting for the cost center to be popped.
+    static constexpr uint64_t flush_threshold_ns = 10000000;
+
+    explicit cost_center(cost_account& account) : m_account(account), m_pending_ns(0) {
+        uint64_t now = thread_cpu_ns();
+        if (auto outer = next()) {
+            static_cast<cost_center*>(outer)->charge(now - s_last_sample_ns);
+        }
+        s_last_sample_ns = now;
+    }
+
+    cost_center(const cost_center&) = delete;
+    cost_center& operator=(const cost_center&) = delete;
+
+    ~cost_center() {
+        uint64_t now = thread_cpu_ns();
+        charge(now - s_last_sample_ns);
+        s_last_sample_ns = now;
+        m_account.charge(m_pending_ns);
+    }
+
+    cost_account& value() override { return m_account; }
+
+    // Charges the time elapsed since the last sample to the innermost cost center, and flushes it.
+    // Useful to bring the account totals up to date while a long-running cost center is active.
+    static void sample() {
+        if (auto top = abstract::top()) {
+            uint64_t now = thread_cpu_ns();
+            auto innermost = static_cast<cost_center*>(top);
+            innermost->charge(now - s_last_sample_ns);
+            innermost->flush();
+            s_last_sample_ns = now;
+        }
+    }
+
+    // Returns the CPU time used by the calling thread, in nanoseconds.
+    static uint64_t thread_cpu_ns() {
+        timespec ts;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return uint64_t(ts.tv_sec) * 1000000000ull + uint64_t(ts.tv_nsec);
+    }
+
+private:
+    void charge(uint64_t ns) {
+        m_pending_ns += ns;
+        if (m_pending_ns >= flush_threshold_ns) {
+            flush();
+        }
+    }
+
+    void flush() {
+        m_account.charge(m_pending_ns);
+        m_pending_ns = 0;
+    }
+
+    cost_account& m_account;
+    uint64_t m_pending_ns;
+
+    // The thread's CPU time when the innermost cost center last changed.
+    static thread_local uint64_t s_last_sample_ns;
+};
+
+inline thread_local uint64_t cost_center::s_last_sample_ns = 0;
+
+// Installing a captured context pushes a cost_center for the captured account, so that the receiving
+// thread samples its clock on the switch and charges the same account.
+template<> struct borrow_traits<cost_center::abstract> {
+    using node = cost_center;
+};
+
+namespace detail
+{
+inline const bool cost_center_propagated = context::propagate<cost_center>();
+}
+
+} // namespace scoped
+
+#endif // _INCLUDE_SCOPED_COST_CENTER_H_
@@ -0,0 +1,131 @@
+/*
+scoped_defer.h
+
+Work deferred to the end of a scope, with coalescing.
+
+Code anywhere in the dynamic extent of a scoped::defer_queue can call defer_queue::defer() to have an
+action run when the innermost queue is destroyed, e.g. flushing metrics, invalidating cache keys or
+releasing leases. The pending actions then run as one batch:
+* Actions enqueued with the same non-zero key are coalesced, and only the last one enqueued runs.
+* Actions run by increasing priority, and in the order they were enqueued within a priority.
+
+A queue constructed with bubble_up hands its pending actions over to the enclosing queue instead of
+running them, so that nested scopes can contribute to the batch of the outermost one. Without any queue,
+defer() runs the action immediately.
+
+Actions enqueued while the batch is running are run as part of the same destruction, in a new batch.
+Actions should not throw.
+
+Example:
+
+void update(const std::string& key) {
+    ...
+    scoped::defer_queue::defer([] { metrics.flush(); }, flush_metrics_key);
+}
+
+void handle_request() {
+    scoped::defer_queue deferred;
+    for (auto& key : keys) {
+        update(key);        // The metrics are flushed once, when the request ends
+    }
+}
+*/
+
+#ifndef _INCLUDE_SCOPED_DEFER_H_
+#define _INCLUDE_SCOPED_DEFER_H_
+
+#include "scoped.h"
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace scoped
+{
+
+class defer_queue : public abstract_scoped<defer_queue> {
+public:
+    // Key of actions which are never coalesced.
+    static constexpr uint64_t no_key = 0;
+
+    explicit defer_queue(bool bubble_up = false) : m_bubble_up(bubble_up) {}
+
+    defer_queue(const defer_queue&) = delete;
+    defer_queue& operator=(const defer_queue&) = delete;
+
+    ~defer_queue() {
+        if (m_bubble_up && next()) {
+            auto& outer = next()->value().m_actions;
+            outer.insert(outer.end(), std::make_move_iterator(m_actions.begin()), std::make_move_iterator(m_actions.end()));
+            return;
+        }
+        while (!m_actions.empty()) {
+            run_batch();
+        }
+    }
+
+    defer_queue& value() override { return *this; }
+
+    // Enqueues action on the innermost queue. Returns false, after running the action, if there is none.
+    template<class F> static bool defer(F&& action, uint64_t key = no_key, int priority = 0) {
+        auto top = abstract::top();
+        if (!top) {
+            std::forward<F>(action)();
+            return false;
+        }
+        top->value().enqueue(std::function<void()>(std::forward<F>(action)), key, priority);
+        return true;
+    }
+
+    void enqueue(std::function<void()> action, uint64_t key = no_key, int priority = 0) {
+        m_actions.push_back({std::move(action), key, priority});
+    }
+
+    // Returns the number of actions enqueued on this queue so far, before coalescing.
+    size_t pending() const { return m_actions.size(); }
+
+private:
+    struct entry {
+        std::function<void()> action;
+        uint64_t key;
+        int priority;
+    };
+
+    void run_batch() {
+        std::vector<entry> batch;
+        batch.swap(m_actions);
+
+        std::unordered_map<uint64_t, size_t> last;
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (batch[i].key != no_key) {
+                last[batch[i].key] = i;
+            }
+        }
+        size_t kept = 0;
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (batch[i].key == no_key || last[batch[i].key] == i) {
+                if (kept != i) {
+                    batch[kept] = std::move(batch[i]);
+                }
+                ++kept;
+            }
+        }
+        batch.resize(kept);
+        std::stable_sort(batch.begin(), batch.end(), [](const entry& a, const entry& b) {
+            return a.priority < b.priority;
+        });
+
+        for (auto& e : batch) {
+            e.action();
+        }
+    }
+
+    bool m_bubble_up;
+    std::vector<entry> m_actions;
+};
+
+} // namespace scoped
+
+#endif // _INCLUDE_SCOPED_DEFER_H_
@@ -0,0 +1,172 @@
+/*
+scoped_fingerprint.h
+
+A compact identity for the current scoped context.
+
+fingerprint<S...>() returns a 64-bit hash of the values in the chains of the scoped types S..., e.g. to
+be used as a component of a cache key, so that results memoized under one scoped configuration are not
+reused under another. The fingerprint of a chain folds the hashes of its values from bottom() to top().
+
+Values pushed with scoped::fingerprinted<T, Tags...> (which is a scoped<T, Tags...> in every other respect)
+compute the fingerprint of their chain once when pushed, by combining the fingerprint below them with
+the hash of their value, so reading it is O(1). Chains whose top is anything else (e.g. a plain
+scoped<T, Tags...>, a value installed from a scoped::context, or a shield) are hashed by walking them,
+which gives the same result. Values are hashed when they are pushed, so they should not be modified while
+they are scoped.
+
+scope_path<S...>() formats the same values for humans, e.g. "/acme/7/debug". The string is built on first
+use and cached per thread until the fingerprint changes.
+
+Example:
+
+using ScopedTenant = scoped::fingerprinted<std::string, struct TenantTag>;
+using ScopedShard = scoped::fingerprinted<int, struct ShardTag>;
+
+void lookup(const std::string& key) {
+    auto cache_key = std::make_pair(key, scoped::fingerprint<ScopedTenant, ScopedShard>());
+    log() << scoped::scope_path<ScopedTenant, ScopedShard>() << ": " << key;
+    ...
+}
+*/
+
+#ifndef _INCLUDE_SCOPED_FINGERPRINT_H_
+#define _INCLUDE_SCOPED_FINGERPRINT_H_
+
+#include "scoped.h"
+#include <cstdint>
+#include <functional>
+#include <sstream>
+#include <string>
+
+namespace scoped
+{
+
+namespace detail
+{
+
+// The splitmix64 finalizer, used to spread std::hash results which are often the identity.
+inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+inline uint64_t combine64(uint64_t parent, uint64_t hash) {
+    return mix64(parent ^ (hash + 0x9e3779b97f4a7c15ull + (parent << 6) + (parent >> 2)));
+}
+
+// The fingerprint of an empty chain.
+constexpr uint64_t empty_fingerprint = 0x6a09e667f3bcc908ull;
+
+} // namespace detail
+
+// Hashes scoped values for fingerprints. Specialize it for types without a std::hash.
+template<class T> struct scoped_hash {
+    uint64_t operator()(const T& value) const {
+        return detail::mix64(uint64_t(std::hash<T>()(value)));
+    }
+};
+
+// The fingerprint of the chain of A on the calling thread.
+template<class A> class chain_fingerprint {
+public:
+    // Returns the fingerprint of the chain below and including node.
+    static uint64_t of(A* node) {
+        if (!node) return detail::empty_fingerprint;
+        if (node == s_owner) return s_value;
+        return detail::combine64(of(node->next()), scoped_hash<typename A::value_type>()(node->value()));
+    }
+
+    static uint64_t get() { return of(A::top()); }
+
+private:
+    template<class T, class ...Tags> friend class fingerprinted;
+
+    // The fingerprint of the chain below and including s_owner, the last fingerprinted node pushed.
+    static thread_local A* s_owner;
+    static thread_local uint64_t s_value;
+};
+
+template<class A> thread_local A* chain_fingerprint<A>::s_owner = nullptr;
+template<class A> thread_local uint64_t chain_fingerprint<A>::s_value = detail::empty_fingerprint;
+
+// A scoped<T, Tags...> that maintains the fingerprint of its chain as it is pushed and popped.
+template<class T, class ...Tags> class fingerprinted : public polymorphic_scoped<T, T, Tags...> {
+public:
+    using base = polymorphic_scoped<T, T, Tags...>;
+    using abstract = typename base::abstract;
+    using fingerprint_type = chain_fingerprint<abstract>;
+
+    template <class... Args>
+    fingerprinted(Args&&... args) : base(std::forward<Args>(args)...) {
+        push();
+    }
+
+    fingerprinted(const fingerprinted&) = delete;
+    fingerprinted& operator=(const fingerprinted&) = delete;
+
+    ~fingerprinted() {
+        if (fingerprint_type::s_owner == this) {
+            fingerprint_type::s_owner = m_saved_owner;
+            fingerprint_type::s_value = m_saved_value;
+        }
+        else {
+            // Popped out of order: the cached fingerprint above us includes our value.
+            fingerprint_type::s_owner = nullptr;
+        }
+    }
+
+private:
+    void push() {
+        m_saved_owner = fingerprint_type::s_owner;
+        m_saved_value = fingerprint_type::s_value;
+        uint64_t value = detail::combine64(fingerprint_type::of(this->next()), scoped_hash<T>()(this->value()));
+        fingerprint_type::s_owner = this;
+        fingerprint_type::s_value = value;
+    }
+
+    abstract* m_saved_owner;
+    uint64_t m_saved_value;
+};
+
+// Returns the fingerprint of the chains of the scoped types S... on the calling thread.
+template<class ...S> uint64_t fingerprint() {
+    uint64_t value = detail::empty_fingerprint;
+    ((value = detail::combine64(value, chain_fingerprint<typename S::abstract>::get())), ...);
+    return value;
+}
+
+namespace detail
+{
+
+template<class S> void append_scope_path(std::ostringstream& out) {
+    for (auto node = S::abstract::bottom(); node; node = node->prev()) {
+        out << '/' << node->value();
+    }
+}
+
+} // namespace detail
+
+// Returns the values in the chains of the scoped types S..., from bottom() to top(), as a path. The
+// reference is valid until the next call on the same thread.
+template<class ...S> const std::string& scope_path() {
+    static thread_local uint64_t s_fingerprint = 0;
+    static thread_local bool s_valid = false;
+    static thread_local std::string s_path;
+    uint64_t current = fingerprint<S...>();
+    if (!s_valid || s_fingerprint != current) {
+        std::ostringstream out;
+        (detail::append_scope_path<S>(out), ...);
+        s_path = out.str();
+        s_fingerprint = current;
+        s_valid = true;
+    }
+    return s_path;
+}
+
+} // namespace scoped
+
+#endif // _INCLUDE_SCOPED_FINGERPRINT_H_
@@ -0,0 +1,303 @@
+/*
+scoped_histogram.h
+
+Scoped latency histograms.
+
+A scoped::histogram is a log-linear (HDR-style) histogram held by a scope. The thread that created it
+records into it without atomics or locks. When it is popped, it is merged into the enclosing histogram
+of the scope, or, at the bottom of the chain, into the named global histogram of histogram_registry.
+
+Buckets are exact below 2^precision_bits, and then split every power of two into 2^(precision_bits-1)
+buckets, so values are kept with a relative error below 2^-(precision_bits-1). Merging adds the bucket
+arrays with SIMD instructions where available.
+
+The histogram chain is registered with scoped::context, so histograms created by workers that installed
+a captured context are merged into the histogram of the scope that captured it. Such merges from other
+threads, as well as values recorded by threads that did not create a histogram of their own, are
+collected separately under a lock, and folded in when the owning thread queries or pops its histogram.
+
+Example:
+
+void query(...) {
+    auto start = now();
+    ...
+    scoped::histogram::record_in_scope(now() - start);
+}
+
+void handle_request() {
+    scoped::histogram latencies("query_ns");    // Merged into the global "query_ns" on exit
+    for (...) {
+        query(...);
+    }
+    log() << "p99 " << latencies.percentile(99.0);
+}
+*/
+
+#ifndef _INCLUDE_SCOPED_HISTOGRAM_H_
+#define _INCLUDE_SCOPED_HISTOGRAM_H_
+
+#include "scoped_context.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace scoped
+{
+
+// The buckets and statistics of a histogram, without any synchronization.
+class histogram_data {
+public:
+    static constexpr int precision_bits = 6;
+    static constexpr size_t half_bucket_count = size_t(1) << (precision_bits - 1);
+    static constexpr size_t num_buckets = (64 - precision_bits + 2) * half_bucket_count;
+
+    histogram_data() : m_counts(num_buckets, 0), m_count(0), m_sum(0), m_min(UINT64_MAX), m_max(0) {}
+
+    void record(uint64_t value, uint64_t count = 1) {
+        m_counts[bucket_of(value)] += count;
+        m_count += count;
+        m_sum += value * count;
+        m_min = std::min(m_min, value);
+        m_max = std::max(m_max, value);
+    }
+
+    // Adds the buckets and statistics of other.
+    void merge(const histogram_data& other) {
+        if (!other.m_count) return;
+        add_buckets(m_counts.data(), other.m_counts.data(), num_buckets);
+        m_count += other.m_count;
+        m_sum += other.m_sum;
+        m_min = std::min(m_min, other.m_min);
+        m_max = std::max(m_max, other.m_max);
+    }
+
+    void clear() {
+        std::fill(m_counts.begin(), m_counts.end(), 0);
+        m_count = m_sum = m_max = 0;
+        m_min = UINT64_MAX;
+    }
+
+    uint64_t count() const { return m_count; }
+    uint64_t min() const { return m_count ? m_min : 0; }
+    uint64_t max() const { return m_max; }
+    double mean() const { return m_count ? double(m_sum) / double(m_count) : 0.0; }
+
+    // Returns the value below which percent of the recorded values fall, up to the bucket precision.
+    uint64_t percentile(double percent) const {
+        if (!m_count) return 0;
+        double wanted = std::max(1.0, std::min(percent, 100.0) / 100.0 * double(m_count));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < num_buckets; ++i) {
+            seen += m_counts[i];
+            if (double(seen) >= wanted) {
+                return std::min(highest_of(i), m_max);
+            }
+        }
+        return m_max;
+    }
+
+    static size_t bucket_of(uint64_t value) {
+        if (value < (uint64_t(1) << precision_bits)) {
+            return size_t(value);
+        }
+        int shift = highest_bit(value) - precision_bits + 1;
+        return size_t(shift) * half_bucket_count + size_t(value >> shift);
+    }
+
+    static uint64_t lowest_of(size_t bucket) {
+        if (bucket < (size_t(1) << precision_bits)) {
+            return bucket;
+        }
+        size_t shift = bucket / half_bucket_count - 1;
+        return uint64_t(bucket - shift * half_bucket_count) << shift;
+    }
+
+    static uint64_t highest_of(size_t bucket) {
+        return bucket + 1 < num_buckets ? lowest_of(bucket + 1) - 1 : UINT64_MAX;
+    }
+
+private:
+    static int highest_bit(uint64_t value) {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanReverse64(&index, value);
+        return int(index);
+#else
+        return 63 - __builtin_clzll(value);
+#endif
+    }
+
+    static void add_buckets(uint64_t* to, const uint64_t* from, size_t n) {
+        size_t i = 0;
+#if defined(__AVX2__)
+        for (; i + 4 <= n; i += 4) {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(to + i));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(from + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(to + i), _mm256_add_epi64(a, b));
+        }
+#elif defined(__SSE2__)
+        for (; i + 2 <= n; i += 2) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(to + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(from + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(to + i), _mm_add_epi64(a, b));
+        }
+#endif
+        for (; i < n; ++i) {
+            to[i] += from[i];
+        }
+    }
+
+    std::vector<uint64_t> m_counts;
+    uint64_t m_count;
+    uint64_t m_sum;
+    uint64_t m_min;
+    uint64_t m_max;
+};
+
+// Named global histograms, which the outermost scoped histograms are merged into.
+class histogram_registry {
+public:
+    static histogram_registry& instance() {
+        static histogram_registry s_instance;
+        return s_instance;
+    }
+
+    void merge(const std::string& name, const histogram_data& data) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_histograms[name].merge(data);
+    }
+
+    // Returns a copy of the named histogram.
+    histogram_data snapshot(const std::string& name) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_histograms.find(name);
+        return it != m_histograms.end() ? it->second : histogram_data();
+    }
+
+    std::vector<std::string> names() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::vector<std::string> result;
+        for (auto& item : m_histograms) {
+            result.push_back(item.first);
+        }
+        return result;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_histograms.clear();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::map<std::string, histogram_data> m_histograms;
+};
+
+class histogram : public abstract_scoped<histogram> {
+public:
+    // A histogram at the bottom of the chain is merged into the global histogram called name, if any.
+    explicit histogram(const char* name = nullptr) : m_name(name), m_owner(thread_marker()), m_has_incoming(false) {}
+
+    histogram(const histogram&) = delete;
+    histogram& operator=(const histogram&) = delete;
+
+    ~histogram() {
+        fold_incoming();
+        if (auto outer = next()) {
+            outer->value().merge(m_data);
+        }
+        else if (m_name) {
+            histogram_registry::instance().merge(m_name, m_data);
+        }
+    }
+
+    histogram& value() override { return *this; }
+
+    // Records value. Recording from the thread that created the histogram takes no lock.
+    void record(uint64_t value, uint64_t count = 1) {
+        if (thread_marker() == m_owner) {
+            m_data.record(value, count);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_incoming_mutex);
+        incoming().record(value, count);
+        m_has_incoming.store(true, std::memory_order_release);
+    }
+
+    // Records value in the innermost histogram, if any.
+    static void record_in_scope(uint64_t value) {
+        if (auto top = abstract::top()) {
+            top->value().record(value);
+        }
+    }
+
+    // Merges data into this histogram. May be called from any thread.
+    void merge(const histogram_data& data) {
+        if (thread_marker() == m_owner) {
+            m_data.merge(data);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_incoming_mutex);
+        incoming().merge(data);
+        m_has_incoming.store(true, std::memory_order_release);
+    }
+
+    // Returns the values recorded and merged so far. Must be called by the thread that created the histogram.
+    const histogram_data& data() {
+        fold_incoming();
+        return m_data;
+    }
+
+    uint64_t percentile(double percent) { return data().percentile(percent); }
+
+private:
+    static const void* thread_marker() {
+        static thread_local char s_marker;
+        return &s_marker;
+    }
+
+    // Values recorded or merged by other threads. Guarded by m_incoming_mutex.
+    histogram_data& incoming() {
+        if (!m_incoming) {
+            m_incoming.reset(new histogram_data());
+        }
+        return *m_incoming;
+    }
+
+    void fold_incoming() {
+        if (m_has_incoming.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(m_incoming_mutex);
+            m_data.merge(*m_incoming);
+            m_incoming->clear();
+            m_has_incoming.store(false, std::memory_order_relaxed);
+        }
+    }
+
+    const char* m_name;
+    const void* m_owner;
+    histogram_data m_data;
+    std::atomic<bool> m_has_incoming;
+    std::mutex m_incoming_mutex;
+    std::unique_ptr<histogram_data> m_incoming;
+};
+
+namespace detail
+{
+inline const bool histogram_propagated = context::propagate<histogram>();
+}
+
+} // namespace scoped
+
+#endif // _INCLUDE_SCOPED_HISTOGRAM_H_
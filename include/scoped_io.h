@@ -0,0 +1,420 @@
+/*
+scoped_io.h
+
+Batches the file I/O issued within a scope into few system calls.
+
+While a scoped::io_batch is active on the calling thread, scoped::read() and scoped::write() do not
+perform their I/O immediately. They queue it in the batch, and return an io_future for the result. The
+batch submits the queued requests at once when threshold requests are queued, and at scope exit, where
+it also waits for all of them to complete. Outside of any batch, read() and write() perform the I/O
+synchronously, and return a ready future.
+
+With the io_uring backend, the requests are written to the submission queue of a per-thread ring, and
+a batch costs one io_uring_enter() call per threshold requests; exiting the scope submits and waits with
+a single call. The io_uring system calls are used directly, without liburing. When io_uring is not
+available (old kernels, seccomp filters), or on request, the thread_pool backend runs pread() and
+pwrite() in scoped::thread_pool instead.
+
+Results are byte counts, or negated errno values. The buffers must stay valid until the I/O completes,
+which is at the latest when the batch exits. Futures of a batch must be waited on by the thread that
+issued them, or after the batch exits.
+
+Linux only.
+
+Example:
+
+void load_blocks(int fd, const std::vector<off_t>& offsets, std::vector<block>& blocks) {
+    scoped::io_batch batch;
+    for (size_t i = 0; i < offsets.size(); ++i) {
+        scoped::read(fd, blocks[i].data, block_size, offsets[i]);
+    }
+}   // One io_uring_enter() per 32 reads, and the reads are complete
+*/
+
+#ifndef _INCLUDE_SCOPED_IO_H_
+#define _INCLUDE_SCOPED_IO_H_
+
+#include "scoped.h"
+#include "scoped_thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace scoped
+{
+
+enum class io_backend {
+    automatic,      // io_uring if available, thread_pool otherwise
+    uring,
+    thread_pool
+};
+
+class io_batch;
+
+namespace detail
+{
+
+// A read or write request, shared by its batch and its future.
+struct io_op {
+    bool is_write;
+    int fd;
+    void* buffer;
+    size_t size;
+    off_t offset;
+    io_batch* batch;
+    ssize_t result = 0;
+    std::atomic<bool> done{false};
+
+    void run_sync() {
+        ssize_t n = is_write ? ::pwrite(fd, buffer, size, offset) : ::pread(fd, buffer, size, offset);
+        result = n < 0 ? -errno : n;
+        done.store(true, std::memory_order_release);
+    }
+};
+
+// An io_uring instance, set up with the raw system calls.
+class uring {
+public:
+    static constexpr unsigned entries = 256;
+
+    uring() : m_fd(-1), m_sq_ring(MAP_FAILED), m_cq_ring(MAP_FAILED), m_sqes(MAP_FAILED), m_sq_tail(0), m_unsubmitted(0) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        m_fd = int(::syscall(__NR_io_uring_setup, entries, &params));
+        if (m_fd < 0) return;
+        m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+        }
+        m_sq_ring = ::mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+        m_cq_ring = single_mmap ? m_sq_ring :
+            ::mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+        m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        m_sqes = ::mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+        if (m_sq_ring == MAP_FAILED || m_cq_ring == MAP_FAILED || m_sqes == MAP_FAILED) {
+            close();
+            return;
+        }
+        auto sq = static_cast<unsigned char*>(m_sq_ring);
+        auto cq = static_cast<unsigned char*>(m_cq_ring);
+        m_sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        m_sq_tail_shared = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        m_sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        m_sq_entries = params.sq_entries;
+        m_sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        m_cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        m_cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        m_cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        m_sq_tail = *m_sq_tail_shared;
+    }
+
+    uring(const uring&) = delete;
+    uring& operator=(const uring&) = delete;
+
+    ~uring() {
+        close();
+    }
+
+    bool ok() const { return m_fd >= 0; }
+
+    // Queues op in the submission queue. Returns false if the queue is full.
+    bool queue(io_op* op) {
+        unsigned head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+        if (m_sq_tail - head >= m_sq_entries) return false;
+        unsigned index = m_sq_tail & m_sq_mask;
+        io_uring_sqe& sqe = static_cast<io_uring_sqe*>(m_sqes)[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = op->is_write ? IORING_OP_WRITE : IORING_OP_READ;
+        sqe.fd = op->fd;
+        sqe.addr = reinterpret_cast<uint64_t>(op->buffer);
+        sqe.len = unsigned(op->size);
+        sqe.off = uint64_t(op->offset);
+        sqe.user_data = reinterpret_cast<uint64_t>(op);
+        m_sq_array[index] = index;
+        ++m_sq_tail;
+        ++m_unsubmitted;
+        return true;
+    }
+
+    // Submits the queued requests and waits for min_complete completions, with one system call, then
+    // completes the operations of the available completions. Returns the number of operations completed.
+    size_t enter(unsigned min_complete) {
+        __atomic_store_n(m_sq_tail_shared, m_sq_tail, __ATOMIC_RELEASE);
+        for (;;) {
+            unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+            long submitted = ::syscall(__NR_io_uring_enter, m_fd, m_unsubmitted, min_complete, flags, nullptr, 0);
+            if (submitted >= 0) {
+                m_unsubmitted -= unsigned(submitted);
+                break;
+            }
+            if (errno == EBUSY) {
+                // Too many completions are pending: reap them, then retry.
+                if (reap()) continue;
+            }
+            if (errno != EINTR) {
+                cancel_unsubmitted(-errno);
+                break;
+            }
+        }
+        return reap();
+    }
+
+    unsigned unsubmitted() const { return m_unsubmitted; }
+
+    // Completes the requests the kernel did not accept with error, and takes them back out of the
+    // submission queue, so that a later enter() does not submit them after their callers saw the error.
+    void cancel_unsubmitted(int error) {
+        for (unsigned i = m_unsubmitted; i; --i) {
+            unsigned index = m_sq_array[(m_sq_tail - i) & m_sq_mask];
+            io_op* op = reinterpret_cast<io_op*>(static_cast<io_uring_sqe*>(m_sqes)[index].user_data);
+            op->result = error;
+            op->done.store(true, std::memory_order_release);
+        }
+        m_sq_tail -= m_unsubmitted;
+        m_unsubmitted = 0;
+        __atomic_store_n(m_sq_tail_shared, m_sq_tail, __ATOMIC_RELEASE);
+    }
+
+private:
+    size_t reap() {
+        unsigned head = *m_cq_head;
+        unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+        size_t count = 0;
+        for (; head != tail; ++head, ++count) {
+            const io_uring_cqe& cqe = m_cqes[head & m_cq_mask];
+            io_op* op = reinterpret_cast<io_op*>(cqe.user_data);
+            op->result = cqe.res;
+            op->done.store(true, std::memory_order_release);
+        }
+        __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+        return count;
+    }
+
+    void close() {
+        if (m_sqes != MAP_FAILED) ::munmap(m_sqes, m_sqes_size);
+        if (m_cq_ring != MAP_FAILED && m_cq_ring != m_sq_ring) ::munmap(m_cq_ring, m_cq_ring_size);
+        if (m_sq_ring != MAP_FAILED) ::munmap(m_sq_ring, m_sq_ring_size);
+        if (m_fd >= 0) ::close(m_fd);
+        m_fd = -1;
+    }
+
+    int m_fd;
+    void* m_sq_ring;
+    void* m_cq_ring;
+    void* m_sqes;
+    size_t m_sq_ring_size;
+    size_t m_cq_ring_size;
+    size_t m_sqes_size;
+    unsigned* m_sq_head;
+    unsigned* m_sq_tail_shared;
+    unsigned* m_sq_array;
+    unsigned m_sq_mask;
+    unsigned m_sq_entries;
+    unsigned* m_cq_head;
+    unsigned* m_cq_tail;
+    unsigned m_cq_mask;
+    io_uring_cqe* m_cqes;
+    unsigned m_sq_tail;
+    unsigned m_unsubmitted;
+};
+
+// The ring of the calling thread, or nullptr if io_uring is not available.
+inline uring* thread_uring() {
+    static thread_local std::unique_ptr<uring> s_ring;
+    static thread_local bool s_tried = false;
+    if (!s_tried) {
+        s_tried = true;
+        s_ring.reset(new uring());
+        if (!s_ring->ok()) {
+            s_ring.reset();
+        }
+    }
+    return s_ring.get();
+}
+
+} // namespace detail
+
+// The result of a read or write: a byte count, or a negated errno value.
+class io_future {
+public:
+    io_future() = default;
+
+    bool valid() const { return bool(m_op); }
+    bool ready() const { return m_op->done.load(std::memory_order_acquire); }
+
+    // Waits for the I/O to complete, submitting the batch's queued requests if needed.
+    inline ssize_t get() const;
+
+private:
+    friend class io_batch;
+    friend io_future read(int, void*, size_t, off_t);
+    friend io_future write(int, const void*, size_t, off_t);
+
+    explicit io_future(std::shared_ptr<detail::io_op> op) : m_op(std::move(op)) {}
+
+    std::shared_ptr<detail::io_op> m_op;
+};
+
+class io_batch : public abstract_scoped<io_batch> {
+public:
+    // Submits the queued requests whenever threshold of them are queued.
+    explicit io_batch(size_t threshold = 32, io_backend backend = io_backend::automatic) :
+        m_threshold(threshold ? threshold : 1), m_ring(nullptr), m_queued(0) {
+        if (backend != io_backend::thread_pool) {
+            m_ring = detail::thread_uring();
+        }
+    }
+
+    io_batch(const io_batch&) = delete;
+    io_batch& operator=(const io_batch&) = delete;
+
+    // Submits the queued requests, and waits for all the requests of the batch to complete.
+    ~io_batch() {
+        wait_all();
+    }
+
+    io_batch& value() override { return *this; }
+
+    // The backend in use, which is thread_pool when io_uring is not available.
+    io_backend backend() const { return m_ring ? io_backend::uring : io_backend::thread_pool; }
+
+    // Queues a request, submitting the queue when it reaches the threshold.
+    io_future queue(std::shared_ptr<detail::io_op> op) {
+        op->batch = this;
+        m_ops.push_back(op);
+        if (m_ring) {
+            while (!m_ring->queue(op.get())) {
+                m_ring->enter(0);
+            }
+        }
+        if (++m_queued >= m_threshold) {
+            submit();
+        }
+        return io_future(std::move(op));
+    }
+
+    // Submits the queued requests without waiting for them.
+    void submit() {
+        if (m_ring) {
+            if (m_ring->unsubmitted()) {
+                m_ring->enter(0);
+            }
+        }
+        else {
+            auto& pool = thread_pool::instance();
+            for (size_t i = m_ops.size() - m_queued; i < m_ops.size(); ++i) {
+                std::shared_ptr<detail::io_op> op = m_ops[i];
+                pool.submit([op] { op->run_sync(); });
+            }
+        }
+        m_queued = 0;
+    }
+
+    // Waits for op, which was queued in this batch, to complete.
+    void wait(const detail::io_op& op) {
+        if (!op.done.load(std::memory_order_acquire) && m_queued) {
+            submit();
+        }
+        while (!op.done.load(std::memory_order_acquire)) {
+            wait_some();
+        }
+    }
+
+    // Waits for all the requests of the batch to complete. With io_uring, submitting and waiting take
+    // a single system call.
+    void wait_all() {
+        if (m_queued && !m_ring) {
+            submit();
+        }
+        m_queued = 0;
+        while (size_t pending = count_pending()) {
+            if (m_ring) {
+                m_ring->enter(unsigned(std::min<size_t>(pending, detail::uring::entries)));
+            }
+            else {
+                wait_some();
+            }
+        }
+        m_ops.clear();
+    }
+
+private:
+    size_t count_pending() const {
+        size_t pending = 0;
+        for (auto& op : m_ops) {
+            pending += !op->done.load(std::memory_order_acquire);
+        }
+        return pending;
+    }
+
+    void wait_some() {
+        if (m_ring) {
+            m_ring->enter(1);
+        }
+        else if (!thread_pool::instance().run_one()) {
+            std::this_thread::yield();
+        }
+    }
+
+    size_t m_threshold;
+    detail::uring* m_ring;
+    size_t m_queued;
+    std::vector<std::shared_ptr<detail::io_op>> m_ops;
+};
+
+inline ssize_t io_future::get() const {
+    while (!ready()) {
+        m_op->batch->wait(*m_op);
+    }
+    return m_op->result;
+}
+
+// Reads size bytes at offset of fd into buffer, in the innermost batch if any.
+inline io_future read(int fd, void* buffer, size_t size, off_t offset) {
+    auto op = std::make_shared<detail::io_op>();
+    op->is_write = false;
+    op->fd = fd;
+    op->buffer = buffer;
+    op->size = size;
+    op->offset = offset;
+    op->batch = nullptr;
+    if (auto batch = io_batch::top()) {
+        return batch->value().queue(std::move(op));
+    }
+    op->run_sync();
+    return io_future(std::move(op));
+}
+
+// Writes size bytes of buffer at offset of fd, in the innermost batch if any.
+inline io_future write(int fd, const void* buffer, size_t size, off_t offset) {
+    auto op = std::make_shared<detail::io_op>();
+    op->is_write = true;
+    op->fd = fd;
+    op->buffer = const_cast<void*>(buffer);
+    op->size = size;
+    op->offset = offset;
+    op->batch = nullptr;
+    if (auto batch = io_batch::top()) {
+        return batch->value().queue(std::move(op));
+    }
+    op->run_sync();
+    return io_future(std::move(op));
+}
+
+} // namespace scoped
+
+#endif // _INCLUDE_SCOPED_IO_H_
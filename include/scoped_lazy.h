@@ -0,0 +1,123 @@
+/*
+scoped_lazy.h
+
+Scoped values constructed on first use.
+
+A scoped::lazy<T, Tags...> is pushed on the chain of abstract_scoped<T, Tags...> when it is constructed,
+like scoped<T, Tags...>, so that it shadows and is shadowed by the same instances, and shields hide it.
+Its value is only built by the first call to value(), from a factory stored in the instance: an
+expensive value that a request never reads costs neither its construction nor its destruction.
+
+The factory is a callable returning a T, stored inline in up to factory_capacity bytes, without
+allocating. It is destroyed once the value is built. If it throws, the exception propagates to the
+caller of value(), and the next call tries again. The value is built once even when the instance is
+read from several threads, e.g. through a scoped::context.
+
+A scoped::context captures the instance, not its value, so capturing one (e.g. for parallel_for)
+does not build the value: the first task that reads it does. A scoped::detached_context (e.g. for
+nursery tasks and scoped::bind()) copies the values it captures, which builds them.
+
+Example:
+
+using Rules = scoped::abstract_scoped<ruleset>;
+
+void handle_request(const request& r) {
+    scoped::lazy<ruleset> rules([&] { return ruleset::parse(r.tenant().rules_path()); });
+    ...
+    if (r.needs_rules()) {
+        apply(Rules::top()->value(), r);                // Parsed here, once per request
+    }
+}
+*/
+
+#ifndef _INCLUDE_SCOPED_LAZY_H_
+#define _INCLUDE_SCOPED_LAZY_H_
+
+#include "scoped.h"
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace scoped
+{
+
+template<class T, class ...Tags> class lazy : public abstract_scoped<T, Tags...> {
+public:
+    using base = abstract_scoped<T, Tags...>;
+
+    // The largest factory stored inline, e.g. a lambda capturing up to six pointers.
+    static constexpr size_t factory_capacity = 48;
+
+    // Constructor that pushes the instance on top of the chain, with a factory for the value.
+    template<class F, class = std::enable_if_t<!std::is_same<std::decay_t<F>, lazy>::value>>
+    explicit lazy(F&& factory) : base() {
+        store(std::forward<F>(factory));
+        this->set_type(type_id<T>());
+    }
+
+    // Constructor that adds the instance to the bottom of the chain.
+    template<class F>
+    lazy(at_bottom_t, F&& factory) : base(at_bottom) {
+        store(std::forward<F>(factory));
+        this->set_type(type_id<T>());
+    }
+
+    lazy(const lazy&) = delete;
+    lazy& operator=(const lazy&) = delete;
+
+    ~lazy() {
+        if (m_built.load(std::memory_order_acquire)) {
+            reinterpret_cast<T*>(m_value)->~T();
+        }
+        else {
+            m_destroy(m_factory);
+        }
+    }
+
+    // Returns the value, building it on the first call.
+    T& value() override {
+        if (!m_built.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_built.load(std::memory_order_relaxed)) {
+                build();
+            }
+        }
+        return *reinterpret_cast<T*>(m_value);
+    }
+
+    // Returns whether the value has been built.
+    bool is_built() const { return m_built.load(std::memory_order_acquire); }
+
+private:
+    template<class F> void store(F&& factory) {
+        using factory_type = std::decay_t<F>;
+        static_assert(sizeof(factory_type) <= factory_capacity, "factory too large to store inline");
+        static_assert(alignof(factory_type) <= alignof(max_align_t), "factory over-aligned");
+        ::new (static_cast<void*>(m_factory)) factory_type(std::forward<F>(factory));
+        m_build = [](void* factory, void* where) {
+            ::new (where) T((*static_cast<factory_type*>(factory))());
+        };
+        m_destroy = [](void* factory) {
+            static_cast<factory_type*>(factory)->~factory_type();
+        };
+    }
+
+    void build() {
+        m_build(m_factory, m_value);
+        m_destroy(m_factory);
+        m_built.store(true, std::memory_order_release);
+    }
+
+    alignas(T) unsigned char m_value[sizeof(T)];
+    alignas(max_align_t) unsigned char m_factory[factory_capacity];
+    void (*m_build)(void* factory, void* where);
+    void (*m_destroy)(void* factory);
+    std::mutex m_mutex;
+    std::atomic<bool> m_built{false};
+};
+
+} // namespace scoped
+
+#endif // _INCLUDE_SCOPED_LAZY_H_
@@ -0,0 +1,83 @@
+/*
+scoped_lifo.h
+
+A compact scoped class for strictly nested scopes.
+
+An abstract_scoped instance carries a vtable pointer and two links, 24 bytes on 64-bit targets, so that
+it can be reached through its abstract base, walked in both directions, and destroyed in any order.
+scoped::lifo<T, Tags...> drops all of that: it is singly linked, has no virtual functions, and must be
+destroyed in the reverse order of construction, which debug builds check. It costs one pointer besides
+its value, and constructing or destroying it updates a single thread_local pointer. This suits scopes
+opened once per frame of a deep recursion.
+
+lifo instances cannot be copied, moved, or put in containers, and have their own chain, separate from
+that of scoped<T, Tags...>. They are not propagated by scoped::context.
+
+Example:
+
+using Depth = scoped::lifo<int, struct DepthTag>;
+
+void visit(const node& n) {
+    Depth depth(Depth::top() ? Depth::top()->value() + 1 : 0);
+    for (auto& child : n.children) {
+        visit(child);
+    }
+}
+*/
+
+#ifndef _INCLUDE_SCOPED_LIFO_H_
+#define _INCLUDE_SCOPED_LIFO_H_
+
+#include "scoped.h"
+#include <utility>
+
+namespace scoped
+{
+
+template<class T, class ...Tags> class lifo {
+public:
+    using value_type = T;
+
+    // Constructor that pushes the instance on top of the chain, with a value initialized from args.
+    template<class ...Args>
+    lifo(Args&&... args) : m_value{std::forward<Args>(args)...}, m_next(s_top) {
+        s_top = this;
+    }
+
+    lifo(const lifo&) = delete;
+    lifo& operator=(const lifo&) = delete;
+
+    // Destructor that pops the instance, which must be on top of the chain.
+    ~lifo() {
+        assert(s_top == this && "lifo instances must be destroyed in reverse order of construction");
+        s_top = m_next;
+    }
+
+    T& value() { return m_value; }
+    const T& value() const { return m_value; }
+
+    // Returns the instance below this one, or nullptr.
+    lifo* next() const { return m_next; }
+
+    // Returns the innermost instance on the calling thread, or nullptr.
+    static lifo* top() { return s_top; }
+
+    // Disable the use of the default new and delete operators, as scoped instances should not be created on the heap.
+    static void* operator new(size_t) = delete;
+    static void* operator new[](size_t) = delete;
+    static void* operator new(size_t, void*) = delete;
+    static void* operator new[](size_t, void*) = delete;
+
+private:
+    T m_value;
+    lifo* m_next;
+
+    static thread_local lifo* s_top;
+};
+
+template<class T, class ...Tags>
+thread_local lifo<T, Tags...>* lifo<T, Tags...>::s_top = nullptr;
+
+} // namespace scoped
+
+#endif // _INCLUDE_SCOPED_LIFO_H_
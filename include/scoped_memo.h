@@ -0,0 +1,234 @@
+/*
+scoped_memo.h
+
+Memoization of functions whose results depend on scoped values.
+
+scoped::memo<R(Args...), Deps...> wraps a function and caches its results. The cache key combines the
+hash of the arguments with scoped::fingerprint<Deps...>(), the fingerprint of the scoped values the
+function reads, so a result computed under one scoped configuration is never returned under another.
+Use scoped::fingerprinted<> for the dependencies to make the fingerprint O(1).
+
+Results are kept in a bounded, direct-mapped table, where a new result replaces the one in its slot:
+* memo_mode::per_thread (the default) gives each thread its own table, without any locking. A thread's
+  table is freed when its thread exits or when the memo is destroyed, whichever comes first.
+* memo_mode::sharded shares the results between threads, in tables guarded by one mutex each.
+
+Arguments must be hashable with scoped::scoped_hash and comparable with ==, and the arguments and result
+must be default constructible and copyable.
+
+Example:
+
+using ScopedThreshold = scoped::fingerprinted<int, struct ThresholdTag>;
+
+int classify_impl(int x) {
+    auto thresh = ScopedThreshold::top();
+    return (thresh && x >= thresh->value()) ? -1 : x;
+}
+
+scoped::memo<int(int), ScopedThreshold> classify(classify_impl);
+*/
+
+#ifndef _INCLUDE_SCOPED_MEMO_H_
+#define _INCLUDE_SCOPED_MEMO_H_
+
+#include "scoped_fingerprint.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace scoped
+{
+
+enum class memo_mode {
+    per_thread,
+    sharded
+};
+
+template<class F, class ...Deps> class memo;
+
+template<class R, class ...Args, class ...Deps> class memo<R(Args...), Deps...> {
+public:
+    using key_type = std::tuple<std::decay_t<Args>...>;
+
+    static constexpr size_t default_capacity = 1024;
+    static constexpr size_t num_shards = 16;
+
+    // Wraps f, keeping up to capacity results per table (rounded up to a power of two).
+    explicit memo(std::function<R(Args...)> f, size_t capacity = default_capacity, memo_mode mode = memo_mode::per_thread) :
+        m_function(std::move(f)), m_capacity(round_up(capacity)), m_mode(mode), m_id(next_id()) {
+        if (m_mode == memo_mode::sharded) {
+            m_shards.reset(new shard[num_shards]);
+            for (size_t i = 0; i < num_shards; ++i) {
+                m_shards[i].slots.resize(std::max<size_t>(m_capacity / num_shards, 1));
+            }
+        }
+        else {
+            m_tables = std::make_shared<table_registry>();
+        }
+    }
+
+    memo(const memo&) = delete;
+    memo& operator=(const memo&) = delete;
+
+    // Returns f(args...), computing it only if it is not cached for the current scoped values of Deps...
+    R operator()(Args... args) {
+        uint64_t context = fingerprint<Deps...>();
+        uint64_t hash = detail::combine64(context, hash_args(args...));
+        if (m_mode == memo_mode::sharded) {
+            shard& s = m_shards[(hash >> 32) % num_shards];
+            {
+                std::lock_guard<std::mutex> lock(s.mutex);
+                if (auto result = lookup(s.slots, hash, context, args...)) {
+                    return *result;
+                }
+            }
+            R result = m_function(args...);
+            std::lock_guard<std::mutex> lock(s.mutex);
+            store(s.slots, hash, context, result, args...);
+            return result;
+        }
+        table& slots = thread_table();
+        if (auto result = lookup(slots, hash, context, args...)) {
+            return *result;
+        }
+        R result = m_function(args...);
+        store(slots, hash, context, result, args...);
+        return result;
+    }
+
+private:
+    struct slot {
+        bool used = false;
+        uint64_t hash = 0;
+        uint64_t context = 0;
+        key_type key;
+        R result;
+    };
+
+    struct shard {
+        std::mutex mutex;
+        std::vector<slot> slots;
+    };
+
+    using table = std::vector<slot>;
+
+    // The per-thread tables of an instance. They are owned here, so that they are freed with the instance
+    // even if their threads keep running.
+    struct table_registry {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<table>> tables;
+
+        void release(table* t) {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto& owned : tables) {
+                if (owned.get() == t) {
+                    owned = std::move(tables.back());
+                    tables.pop_back();
+                    return;
+                }
+            }
+        }
+    };
+
+    // The tables of the calling thread, by instance id. Exiting threads release their tables from the
+    // instances that are still alive.
+    struct thread_tables {
+        struct entry {
+            std::weak_ptr<table_registry> owner;
+            table* t;
+        };
+
+        std::unordered_map<uint64_t, entry> entries;
+
+        ~thread_tables() {
+            for (auto& e : entries) {
+                if (auto owner = e.second.owner.lock()) {
+                    owner->release(e.second.t);
+                }
+            }
+        }
+
+        // Forgets the tables of destroyed instances.
+        void prune() {
+            for (auto it = entries.begin(); it != entries.end();) {
+                it = it->second.owner.expired() ? entries.erase(it) : std::next(it);
+            }
+        }
+    };
+
+    static size_t round_up(size_t capacity) {
+        size_t rounded = 1;
+        while (rounded < capacity) rounded <<= 1;
+        return rounded;
+    }
+
+    static uint64_t next_id() {
+        static std::atomic<uint64_t> s_next_id(1);
+        return s_next_id.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static uint64_t hash_args(const Args&... args) {
+        uint64_t hash = detail::empty_fingerprint;
+        ((hash = detail::combine64(hash, scoped_hash<std::decay_t<Args>>()(args))), ...);
+        return hash;
+    }
+
+    static const R* lookup(std::vector<slot>& slots, uint64_t hash, uint64_t context, const Args&... args) {
+        const slot& s = slots[hash & (slots.size() - 1)];
+        if (s.used && s.hash == hash && s.context == context && s.key == std::tie(args...)) {
+            return &s.result;
+        }
+        return nullptr;
+    }
+
+    static void store(std::vector<slot>& slots, uint64_t hash, uint64_t context, const R& result, const Args&... args) {
+        slot& s = slots[hash & (slots.size() - 1)];
+        s.used = true;
+        s.hash = hash;
+        s.context = context;
+        s.key = key_type(args...);
+        s.result = result;
+    }
+
+    // Returns the calling thread's table for this instance. Tables are looked up by instance id rather
+    // than address, so that a new instance never sees the table of a destroyed one.
+    table& thread_table() {
+        static thread_local uint64_t s_last_id = 0;
+        static thread_local table* s_last_table = nullptr;
+        if (s_last_id == m_id) {
+            return *s_last_table;
+        }
+        static thread_local thread_tables s_tables;
+        auto it = s_tables.entries.find(m_id);
+        if (it == s_tables.entries.end()) {
+            s_tables.prune();
+            std::unique_ptr<table> created(new table(m_capacity));
+            table* t = created.get();
+            {
+                std::lock_guard<std::mutex> lock(m_tables->mutex);
+                m_tables->tables.push_back(std::move(created));
+            }
+            it = s_tables.entries.emplace(m_id, typename thread_tables::entry{m_tables, t}).first;
+        }
+        s_last_id = m_id;
+        s_last_table = it->second.t;
+        return *it->second.t;
+    }
+
+    std::function<R(Args...)> m_function;
+    size_t m_capacity;
+    memo_mode m_mode;
+    uint64_t m_id;
+    std::unique_ptr<shard[]> m_shards;
+    std::shared_ptr<table_registry> m_tables;
+};
+
+} // namespace scoped
+
+#endif // _INCLUDE_SCOPED_MEMO_H_
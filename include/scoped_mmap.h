@@ -0,0 +1,176 @@
+/*
+scoped_mmap.h
+
+Scoped cache of read-only memory-mapped files.
+
+scoped::map_file(path) returns a read-only view of the whole file. While a scoped::mmap_cache is active on
+the calling thread, the file is mapped once, by the innermost cache, and the same view is returned to every
+later request for the path within the scope, including from nested caches. The cache unmaps all its files
+when its scope exits, so views must not be used after that. Files can be mapped with MADV_SEQUENTIAL and
+MADV_WILLNEED hints.
+
+Without an active cache, map_file() maps the file for the returned view alone; the mapping is shared by
+the copies of the view, and unmapped when the last one is destroyed.
+
+Views are spans of const char (std::span is C++20, this library targets C++17). Errors are reported with
+std::system_error. Linux and other POSIX systems only.
+
+Example:
+
+void parse_include(const std::string& path) {
+    scoped::mmap_view text = scoped::map_file(path);   // Mapped once per request
+    ...
+}
+
+void handle_request() {
+    scoped::mmap_cache files(scoped::mmap_cache::sequential);
+    ...
+}
+*/
+
+#ifndef _INCLUDE_SCOPED_MMAP_H_
+#define _INCLUDE_SCOPED_MMAP_H_
+
+#include "scoped.h"
+#include <cerrno>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace scoped
+{
+
+// A read-only view of a mapped file.
+class mmap_view {
+public:
+    mmap_view() : m_data(nullptr), m_size(0) {}
+    mmap_view(const char* data, size_t size, std::shared_ptr<void> owner = nullptr) :
+        m_data(data), m_size(size), m_owner(std::move(owner)) {}
+
+    const char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    const char* begin() const { return m_data; }
+    const char* end() const { return m_data + m_size; }
+    const char& operator[](size_t i) const { return m_data[i]; }
+
+    std::string_view str() const { return std::string_view(m_data, m_size); }
+
+    // Gives the kernel a madvise() hint about the use of the view.
+    void advise(int advice) const {
+        if (m_size) {
+            ::madvise(const_cast<char*>(m_data), m_size, advice);
+        }
+    }
+
+private:
+    const char* m_data;
+    size_t m_size;
+    std::shared_ptr<void> m_owner;
+};
+
+namespace detail
+{
+
+// Maps the file at path read-only, applying the hints. Returns {nullptr, 0} for empty files.
+inline std::pair<void*, size_t> map_file(const std::string& path, bool sequential, bool will_need) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "open " + path);
+    }
+    struct stat st;
+    if (::fstat(fd, &st) < 0) {
+        int error = errno;
+        ::close(fd);
+        throw std::system_error(error, std::generic_category(), "fstat " + path);
+    }
+    size_t size = size_t(st.st_size);
+    void* data = nullptr;
+    if (size) {
+        data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            int error = errno;
+            ::close(fd);
+            throw std::system_error(error, std::generic_category(), "mmap " + path);
+        }
+        if (sequential) ::madvise(data, size, MADV_SEQUENTIAL);
+        if (will_need) ::madvise(data, size, MADV_WILLNEED);
+    }
+    // The mapping stays valid once the descriptor is closed.
+    ::close(fd);
+    return {data, size};
+}
+
+} // namespace detail
+
+class mmap_cache : public abstract_scoped<mmap_cache> {
+public:
+    // Hints applied to the files the cache maps.
+    enum hints {
+        none = 0,
+        sequential = 1,     // MADV_SEQUENTIAL: aggressive read-ahead, pages freed soon after access
+        will_need = 2       // MADV_WILLNEED: start reading the whole file in
+    };
+
+    explicit mmap_cache(int hints = none) : m_hints(hints) {}
+
+    mmap_cache(const mmap_cache&) = delete;
+    mmap_cache& operator=(const mmap_cache&) = delete;
+
+    // Unmaps all the files mapped by this cache.
+    ~mmap_cache() {
+        for (auto& item : m_files) {
+            if (item.second.size()) {
+                ::munmap(const_cast<char*>(item.second.data()), item.second.size());
+            }
+        }
+    }
+
+    mmap_cache& value() override { return *this; }
+
+    // Returns the view of path mapped by this cache or an enclosing one, mapping it in this cache if none did.
+    mmap_view get(const std::string& path) {
+        for (abstract* cache = this; cache; cache = cache->next()) {
+            auto& files = cache->value().m_files;
+            auto it = files.find(path);
+            if (it != files.end()) {
+                return it->second;
+            }
+        }
+        auto mapping = detail::map_file(path, m_hints & sequential, m_hints & will_need);
+        mmap_view view(static_cast<const char*>(mapping.first), mapping.second);
+        m_files.emplace(path, view);
+        return view;
+    }
+
+    // The number of files mapped by this cache.
+    size_t size() const { return m_files.size(); }
+
+private:
+    int m_hints;
+    std::unordered_map<std::string, mmap_view> m_files;
+};
+
+// Returns a view of the file at path, through the innermost mmap_cache if any.
+inline mmap_view map_file(const std::string& path) {
+    if (auto cache = mmap_cache::top()) {
+        return cache->value().get(path);
+    }
+    auto mapping = detail::map_file(path, false, false);
+    size_t size = mapping.second;
+    std::shared_ptr<void> owner(mapping.first, [size](void* data) {
+        if (size) ::munmap(data, size);
+    });
+    return mmap_view(static_cast<const char*>(mapping.first), size, std::move(owner));
+}
+
+} // namespace scoped
+
+#endif // _INCLUDE_SCOPED_MMAP_H_
@@ -0,0 +1,307 @@
+/*
+scoped_nursery.h
+
+Structured concurrency: tasks spawned within a scope are joined when the scope exits.
+
+A scoped::nursery is a scope that tasks can be spawned into from anywhere in its dynamic extent, with
+nursery::top()->spawn(f). Each task installs the scoped values captured when it was spawned, so it sees
+the spawner's scoped values, including the nursery itself, and can spawn more tasks into it.
+
+Tasks hold copies of the spawner's copyable scoped values, taken with a scoped::detached_context, since
+they may run after the function that spawned them has returned. Values that cannot be copied, such as
+the nursery itself, are referred to, and must outlive the nursery.
+
+Spawned tasks go into a bounded lock-free queue owned by the nursery, and scoped::thread_pool is asked
+to run them. A task is run inline when the queue is full. Threads joining a nursery run its pending
+tasks, and then other pending pool tasks, instead of blocking, so nested nurseries do not need more
+threads than the pool has.
+
+join() waits for all the tasks and throws a nursery_error holding the exceptions they threw, if any. The
+destructor joins as well, and throws the nursery_error only when it is not called during stack
+unwinding; prefer calling join() explicitly.
+
+Example:
+
+void index(const document& d) {
+    for (auto& section : d.sections()) {
+        scoped::nursery::top()->spawn([&section] { index_section(section); });
+    }
+}
+
+void index_all(const std::vector<document>& docs) {
+    scoped::nursery tasks;
+    for (auto& d : docs) {
+        index(d);
+    }
+    tasks.join();       // All sections are indexed
+}
+*/
+
+#ifndef _INCLUDE_SCOPED_NURSERY_H_
+#define _INCLUDE_SCOPED_NURSERY_H_
+
+#include "scoped_context.h"
+#include "scoped_thread_pool.h"
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace scoped
+{
+
+// Thrown by nursery::join() when tasks threw exceptions.
+class nursery_error : public std::runtime_error {
+public:
+    explicit nursery_error(std::vector<std::exception_ptr> errors) :
+        std::runtime_error(describe(errors)), m_errors(std::move(errors)) {}
+
+    // The exceptions thrown by the tasks, in the order they finished.
+    const std::vector<std::exception_ptr>& errors() const { return m_errors; }
+
+private:
+    static std::string describe(const std::vector<std::exception_ptr>& errors) {
+        std::string what = std::to_string(errors.size()) + " nursery task(s) failed";
+        try {
+            std::rethrow_exception(errors.front());
+        }
+        catch (const std::exception& e) {
+            what += std::string(": ") + e.what();
+        }
+        catch (...) {
+        }
+        return what;
+    }
+
+    std::vector<std::exception_ptr> m_errors;
+};
+
+namespace detail
+{
+
+// A bounded multi-producer multi-consumer queue (Dmitry Vyukov's), with a sequence number per slot.
+template<class T, size_t Capacity> class mpmc_queue {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    mpmc_queue() : m_enqueue(0), m_dequeue(0) {
+        for (size_t i = 0; i < Capacity; ++i) {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    mpmc_queue(const mpmc_queue&) = delete;
+    mpmc_queue& operator=(const mpmc_queue&) = delete;
+
+    ~mpmc_queue() {
+        T item;
+        while (try_pop(item)) {
+        }
+    }
+
+    // Returns false, leaving item untouched, if the queue is full.
+    bool try_push(T& item) {
+        size_t pos = m_enqueue.load(std::memory_order_relaxed);
+        for (;;) {
+            slot& s = m_slots[pos & (Capacity - 1)];
+            size_t sequence = s.sequence.load(std::memory_order_acquire);
+            if (sequence == pos) {
+                if (m_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    new (s.storage) T(std::move(item));
+                    s.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (sequence < pos) {
+                return false;
+            }
+            else {
+                pos = m_enqueue.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Returns false if the queue is empty.
+    bool try_pop(T& item) {
+        size_t pos = m_dequeue.load(std::memory_order_relaxed);
+        for (;;) {
+            slot& s = m_slots[pos & (Capacity - 1)];
+            size_t sequence = s.sequence.load(std::memory_order_acquire);
+            if (sequence == pos + 1) {
+                if (m_dequeue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    T* stored = std::launder(reinterpret_cast<T*>(s.storage));
+                    item = std::move(*stored);
+                    stored->~T();
+                    s.sequence.store(pos + Capacity, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (sequence < pos + 1) {
+                return false;
+            }
+            else {
+                pos = m_dequeue.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct slot {
+        std::atomic<size_t> sequence;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    slot m_slots[Capacity];
+    alignas(64) std::atomic<size_t> m_enqueue;
+    alignas(64) std::atomic<size_t> m_dequeue;
+};
+
+// The state of a nursery, shared with the pool tasks that run its queue, which may outlive it.
+class nursery_state {
+public:
+    static constexpr size_t queue_capacity = 256;
+
+    nursery_state() : m_pending(0), m_spawned(0), m_waiters(0) {}
+
+    void spawn(std::function<void()> task) {
+        m_pending.fetch_add(1, std::memory_order_acq_rel);
+        if (!m_queue.try_push(task)) {
+            run(task);
+            return;
+        }
+        // Wake the joining threads, so that they run the new task if the pool is busy.
+        m_spawned.fetch_add(1);
+        if (m_waiters.load() > 0) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_done.notify_all();
+        }
+    }
+
+    // Runs one queued task. Returns false if there was none.
+    bool run_one() {
+        std::function<void()> task;
+        if (!m_queue.try_pop(task)) return false;
+        run(task);
+        return true;
+    }
+
+    // Runs queued tasks and other pool tasks until all the spawned tasks are done.
+    void wait(thread_pool& pool) {
+        while (m_pending.load(std::memory_order_acquire) > 0) {
+            // Tasks queued after this snapshot end the wait below.
+            size_t spawned = m_spawned.load();
+            if (run_one() || pool.run_one()) continue;
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_waiters.fetch_add(1);
+            m_done.wait(lock, [this, spawned] { return m_pending.load() == 0 || m_spawned.load() != spawned; });
+            m_waiters.fetch_sub(1);
+        }
+    }
+
+    std::vector<std::exception_ptr> take_errors() {
+        std::vector<std::exception_ptr> errors;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        errors.swap(m_errors);
+        return errors;
+    }
+
+private:
+    void run(std::function<void()>& task) {
+        try {
+            task();
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_errors.push_back(std::current_exception());
+        }
+        if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_done.notify_all();
+        }
+    }
+
+    mpmc_queue<std::function<void()>, queue_capacity> m_queue;
+    std::atomic<size_t> m_pending;
+    std::atomic<size_t> m_spawned;
+    std::atomic<size_t> m_waiters;
+    std::mutex m_mutex;
+    std::condition_variable m_done;
+    std::vector<std::exception_ptr> m_errors;
+};
+
+struct nursery_tag;
+
+} // namespace detail
+
+class nursery {
+public:
+    // The chain of nurseries, registered with scoped::context.
+    using scope = scoped<nursery*, detail::nursery_tag>;
+
+    nursery() : m_state(std::make_shared<detail::nursery_state>()), m_pool(&thread_pool::instance()),
+        m_uncaught(std::uncaught_exceptions()), m_scope(this) {}
+
+    nursery(const nursery&) = delete;
+    nursery& operator=(const nursery&) = delete;
+
+    // Joins the tasks. Their exceptions are thrown unless the nursery is destroyed by stack unwinding.
+    ~nursery() noexcept(false) {
+        m_state->wait(*m_pool);
+        auto errors = m_state->take_errors();
+        if (!errors.empty() && std::uncaught_exceptions() == m_uncaught) {
+            throw nursery_error(std::move(errors));
+        }
+    }
+
+    // Returns the innermost nursery, or nullptr.
+    static nursery* top() {
+        auto top = scope::top();
+        return top ? top->value() : nullptr;
+    }
+
+    // Runs f in the pool, with copies of the calling thread's scoped values installed.
+    template<class F> void spawn(F&& f) {
+        auto ctx = detached_context::capture();
+        m_state->spawn([ctx = std::move(ctx), f = std::forward<F>(f)]() mutable {
+            auto guard = ctx.install();
+            f();
+        });
+        std::weak_ptr<detail::nursery_state> state = m_state;
+        m_pool->submit([state] {
+            if (auto s = state.lock()) {
+                s->run_one();
+            }
+        });
+    }
+
+    // Waits for the tasks spawned so far, and for the tasks they spawn, running pending tasks meanwhile.
+    // Throws a nursery_error if any of them threw.
+    void join() {
+        m_state->wait(*m_pool);
+        auto errors = m_state->take_errors();
+        if (!errors.empty()) {
+            throw nursery_error(std::move(errors));
+        }
+    }
+
+private:
+    std::shared_ptr<detail::nursery_state> m_state;
+    thread_pool* m_pool;
+    int m_uncaught;
+    scope m_scope;
+};
+
+namespace detail
+{
+inline const bool nursery_propagated = context::propagate<nursery::scope>();
+}
+
+} // namespace scoped
+
+#endif // _INCLUDE_SCOPED_NURSERY_H_
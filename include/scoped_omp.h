@@ -0,0 +1,44 @@
+/*
+scoped_omp.h
+
+Propagates scoped values into OpenMP parallel regions.
+
+Each OpenMP worker thread has its own chains of scoped instances, so the values scoped by the code that
+starts a parallel region are not visible inside of it. SCOPED_OMP_PARALLEL(clauses) starts a parallel
+region like "#pragma omp parallel clauses", after capturing a scoped::context on the encountering thread,
+and installs it in every thread of the team for the duration of the region. The encountering thread,
+which already sees its own values, pushes nothing.
+
+Only chains registered with scoped::context::propagate<>() are propagated. Work-sharing constructs are
+used inside the region as usual. Without OpenMP, the region simply runs on the calling thread.
+
+Example:
+
+using ScopedThreshold = scoped::scoped<int, struct ThresholdTag>;
+static const bool threshold_propagated = scoped::context::propagate<ScopedThreshold>();
+
+void clamp_all(std::vector<int>& v) {
+    SCOPED_OMP_PARALLEL(num_threads(8)) {
+        #pragma omp for
+        for (size_t i = 0; i < v.size(); ++i) {
+            v[i] = std::min(v[i], ScopedThreshold::top()->value());
+        }
+    }
+}
+*/
+
+#ifndef _INCLUDE_SCOPED_OMP_H_
+#define _INCLUDE_SCOPED_OMP_H_
+
+#include "scoped_context.h"
+
+#define SCOPED_OMP_PRAGMA(x) _Pragma(#x)
+
+// Starts "#pragma omp parallel <clauses>" over the following statement, with the scoped context of the
+// encountering thread installed in every thread of the team.
+#define SCOPED_OMP_PARALLEL(...) \
+    if (const ::scoped::context scoped_omp_context_ = ::scoped::context::capture(); true) \
+        SCOPED_OMP_PRAGMA(omp parallel __VA_ARGS__) \
+        if (const ::scoped::context::guard scoped_omp_guard_(scoped_omp_context_); true)
+
+#endif // _INCLUDE_SCOPED_OMP_H_
@@ -0,0 +1,198 @@
+/*
+scoped_output.h
+
+Scoped output buffering, flushed with writev().
+
+scoped::output() writes text to a file descriptor (stdout by default). While a scoped::output_buffer for
+that descriptor is active on the calling thread, the text is appended to the innermost one instead of
+being written. A buffer keeps the text in chunks, and writes all of them with a single writev() call
+when it holds capacity bytes, or when its scope exits. A buffer nested in another buffer of the same
+descriptor hands its chunks over to the enclosing buffer instead of writing them, so that the output of
+a whole request can leave in one system call.
+
+Without an active buffer, output() writes the text directly.
+
+Buffers are not shared between threads: text written by other threads, even those that installed a
+scoped::context, is not appended to them.
+
+Example:
+
+void log(const std::string& message) {
+    scoped::output(message + "\n");
+}
+
+void handle_request() {
+    scoped::output_buffer buffer;   // All the messages of the request are written at once
+    log("start");
+    ...
+    log("done");
+}
+*/
+
+#ifndef _INCLUDE_SCOPED_OUTPUT_H_
+#define _INCLUDE_SCOPED_OUTPUT_H_
+
+#include "scoped.h"
+#include <algorithm>
+#include <cerrno>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace scoped
+{
+
+namespace detail
+{
+
+// Writes all of data to fd, retrying on partial writes. Returns 0, or the errno of the failure.
+inline int write_all(int fd, const char* data, size_t size) {
+    while (size) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+        data += n;
+        size -= size_t(n);
+    }
+    return 0;
+}
+
+// Writes all of the chunks to fd, with as few writev() calls as possible. Returns 0, or the errno of the
+// failure.
+inline int writev_all(int fd, const std::vector<std::string>& chunks) {
+    std::vector<iovec> iov;
+    iov.reserve(std::min<size_t>(chunks.size(), IOV_MAX));
+    size_t next = 0;
+    while (next < chunks.size()) {
+        iov.clear();
+        for (; next < chunks.size() && iov.size() < IOV_MAX; ++next) {
+            if (!chunks[next].empty()) {
+                iov.push_back({const_cast<char*>(chunks[next].data()), chunks[next].size()});
+            }
+        }
+        size_t first = 0;
+        while (first < iov.size()) {
+            ssize_t n = ::writev(fd, iov.data() + first, int(iov.size() - first));
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return errno;
+            }
+            // Skip what was written, which may end in the middle of a chunk.
+            for (size_t written = size_t(n); written;) {
+                size_t step = std::min(written, iov[first].iov_len);
+                iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + step;
+                iov[first].iov_len -= step;
+                written -= step;
+                if (!iov[first].iov_len) ++first;
+            }
+        }
+    }
+    return 0;
+}
+
+} // namespace detail
+
+class output_buffer : public abstract_scoped<output_buffer> {
+public:
+    // Text is appended to chunks of chunk_size bytes, or more for longer text.
+    static constexpr size_t chunk_size = 4096;
+
+    // Buffers up to capacity bytes for fd.
+    explicit output_buffer(int fd = STDOUT_FILENO, size_t capacity = 64 * 1024) :
+        m_fd(fd), m_capacity(capacity), m_size(0), m_error(0) {}
+
+    output_buffer(const output_buffer&) = delete;
+    output_buffer& operator=(const output_buffer&) = delete;
+
+    ~output_buffer() {
+        flush();
+    }
+
+    output_buffer& value() override { return *this; }
+
+    int fd() const { return m_fd; }
+
+    // The number of bytes buffered.
+    size_t size() const { return m_size; }
+
+    // The errno of the last failed write, or 0.
+    int error() const { return m_error; }
+
+    void append(const char* data, size_t size) {
+        if (m_chunks.empty() || m_chunks.back().capacity() - m_chunks.back().size() < size) {
+            m_chunks.emplace_back();
+            m_chunks.back().reserve(std::max(size, chunk_size));
+        }
+        m_chunks.back().append(data, size);
+        m_size += size;
+        if (m_size >= m_capacity) {
+            flush();
+        }
+    }
+
+    // Hands the buffered text over to the enclosing buffer of the same descriptor, if any, or writes it.
+    void flush() {
+        if (!m_size) return;
+        if (output_buffer* outer = find(next(), m_fd)) {
+            outer->adopt(m_chunks, m_size);
+        }
+        else if (int error = detail::writev_all(m_fd, m_chunks)) {
+            m_error = error;
+        }
+        m_chunks.clear();
+        m_size = 0;
+    }
+
+    // Returns the innermost buffer of fd, starting from the given buffer, or nullptr.
+    static output_buffer* find(abstract* from, int fd) {
+        for (; from; from = from->next()) {
+            if (from->value().m_fd == fd) {
+                return &from->value();
+            }
+        }
+        return nullptr;
+    }
+
+    // Appends text to the innermost buffer of fd, or writes it if there is none. Returns false if the
+    // direct write failed.
+    static bool write_in_scope(int fd, const char* data, size_t size) {
+        if (output_buffer* buffer = find(top(), fd)) {
+            buffer->append(data, size);
+            return true;
+        }
+        return detail::write_all(fd, data, size) == 0;
+    }
+
+private:
+    // Takes the chunks of a nested buffer, without copying them.
+    void adopt(std::vector<std::string>& chunks, size_t size) {
+        for (auto& chunk : chunks) {
+            m_chunks.push_back(std::move(chunk));
+        }
+        m_size += size;
+        if (m_size >= m_capacity) {
+            flush();
+        }
+    }
+
+    int m_fd;
+    size_t m_capacity;
+    size_t m_size;
+    int m_error;
+    std::vector<std::string> m_chunks;
+};
+
+// Writes text to fd, through the innermost output_buffer of fd if any.
+inline bool output(std::string_view text, int fd = STDOUT_FILENO) {
+    return output_buffer::write_in_scope(fd, text.data(), text.size());
+}
+
+} // namespace scoped
+
+#endif // _INCLUDE_SCOPED_OUTPUT_H_
@@ -0,0 +1,296 @@
+/*
+scoped_parallel.h
+
+Parallel algorithms whose degree of parallelism is controlled by the caller's scope.
+
+A scoped::task_arena limits the number of threads the parallel algorithms use within its dynamic extent,
+and optionally the CPUs their worker threads run on. Nested arenas compose: an arena can only narrow the
+limits of the arena enclosing it, and the helper threads working for an inner arena count against the
+outer arenas as well, so that nested parallel work stays within the outermost limit.
+
+parallel_for, parallel_reduce and parallel_sort run inline when the arena allows a single thread.
+Otherwise they split the work into chunks, which the calling thread processes together with helper
+threads from scoped::thread_pool. Helpers install the caller's scoped::context, so the work sees the
+caller's scoped values (including the arena itself). While waiting for helpers, the caller runs pending
+pool tasks. Exceptions thrown by the work are rethrown in the caller, after all helpers are done.
+
+Example:
+
+void library_code(std::vector<double>& v) {
+    scoped::parallel_for(0, v.size(), [&](size_t i) { v[i] = std::sqrt(v[i]); });
+}
+
+void caller(std::vector<double>& v) {
+    scoped::task_arena arena(4);      // library_code uses at most 4 threads
+    library_code(v);
+}
+*/
+
+#ifndef _INCLUDE_SCOPED_PARALLEL_H_
+#define _INCLUDE_SCOPED_PARALLEL_H_
+
+#include "scoped_context.h"
+#include "scoped_thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <iterator>
+#include <mutex>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace scoped
+{
+
+class task_arena : public abstract_scoped<task_arena> {
+public:
+    // Allows up to max_concurrency threads, running helpers on the given CPUs (any CPU if empty). The
+    // limits are narrowed to those of the enclosing arena, if any.
+    explicit task_arena(size_t max_concurrency, std::vector<int> cpus = {}) : m_outer(nullptr), m_helpers(0) {
+        if (auto outer = next()) {
+            m_outer = &outer->value();
+        }
+        m_max_concurrency = std::max<size_t>(1, std::min(max_concurrency, m_outer ? m_outer->max_concurrency() : max_concurrency));
+        m_cpus = std::move(cpus);
+        if (m_outer && !m_outer->cpus().empty()) {
+            if (m_cpus.empty()) {
+                m_cpus = m_outer->cpus();
+            }
+            else {
+                std::vector<int> allowed;
+                for (int cpu : m_cpus) {
+                    if (std::find(m_outer->cpus().begin(), m_outer->cpus().end(), cpu) != m_outer->cpus().end()) {
+                        allowed.push_back(cpu);
+                    }
+                }
+                m_cpus = allowed.empty() ? m_outer->cpus() : allowed;
+            }
+        }
+    }
+
+    task_arena(const task_arena&) = delete;
+    task_arena& operator=(const task_arena&) = delete;
+
+    task_arena& value() override { return *this; }
+
+    size_t max_concurrency() const { return m_max_concurrency; }
+    const std::vector<int>& cpus() const { return m_cpus; }
+
+    // Returns the number of threads the innermost arena allows, or the number of hardware threads.
+    static size_t current_concurrency() {
+        auto top = abstract::top();
+        return top ? top->value().max_concurrency() : default_concurrency();
+    }
+
+    static size_t default_concurrency() {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // Reserves a helper thread in this arena and all the arenas enclosing it. Returns false if one of
+    // them is already running as many helpers as it allows.
+    bool try_acquire_helper() {
+        for (task_arena* a = this; a; a = a->m_outer) {
+            if (a->m_helpers.fetch_add(1, std::memory_order_acq_rel) + 1 >= a->m_max_concurrency) {
+                for (task_arena* b = this; b != a->m_outer; b = b->m_outer) {
+                    b->m_helpers.fetch_sub(1, std::memory_order_acq_rel);
+                }
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void release_helper() {
+        for (task_arena* a = this; a; a = a->m_outer) {
+            a->m_helpers.fetch_sub(1, std::memory_order_acq_rel);
+        }
+    }
+
+private:
+    task_arena* m_outer;
+    size_t m_max_concurrency;
+    std::vector<int> m_cpus;
+    std::atomic<size_t> m_helpers;
+};
+
+namespace detail
+{
+
+inline const bool task_arena_propagated = context::propagate<task_arena>();
+
+// Runs a helper on the CPUs of an arena, restoring the thread's affinity afterwards.
+class affinity_guard {
+public:
+    explicit affinity_guard(const std::vector<int>& cpus) : m_changed(false) {
+#if defined(__linux__)
+        if (cpus.empty()) return;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus) {
+            CPU_SET(cpu, &set);
+        }
+        m_changed = sched_getaffinity(0, sizeof(m_saved), &m_saved) == 0 && sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+        (void)cpus;
+#endif
+    }
+
+    affinity_guard(const affinity_guard&) = delete;
+    affinity_guard& operator=(const affinity_guard&) = delete;
+
+    ~affinity_guard() {
+#if defined(__linux__)
+        if (m_changed) {
+            sched_setaffinity(0, sizeof(m_saved), &m_saved);
+        }
+#endif
+    }
+
+private:
+    bool m_changed;
+#if defined(__linux__)
+    cpu_set_t m_saved;
+#endif
+};
+
+// Calls chunk(i) for every i in [0, num_chunks), on the calling thread and on helpers.
+template<class F> void run_chunks(size_t num_chunks, F&& chunk) {
+    if (num_chunks == 0) return;
+    auto top = task_arena::top();
+    task_arena* arena = top ? &top->value() : nullptr;
+    size_t concurrency = arena ? arena->max_concurrency() : task_arena::default_concurrency();
+    size_t helpers = std::min(concurrency, num_chunks) - 1;
+    if (helpers == 0) {
+        for (size_t i = 0; i < num_chunks; ++i) {
+            chunk(i);
+        }
+        return;
+    }
+    auto& pool = thread_pool::instance();
+    helpers = std::min(helpers, pool.size());
+
+    struct state {
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> pending_helpers{0};
+        std::atomic<bool> failed{false};
+        std::mutex mutex;
+        std::exception_ptr error;
+        context ctx;
+    } s;
+    s.ctx = context::capture();
+
+    auto process = [&s, &chunk, num_chunks] {
+        for (size_t i; !s.failed.load(std::memory_order_relaxed) && (i = s.next.fetch_add(1)) < num_chunks;) {
+            try {
+                chunk(i);
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(s.mutex);
+                if (!s.error) {
+                    s.error = std::current_exception();
+                }
+                s.failed.store(true, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    s.pending_helpers.store(helpers);
+    for (size_t h = 0; h < helpers; ++h) {
+        pool.submit([&s, &process, arena, num_chunks] {
+            if (s.next.load(std::memory_order_relaxed) < num_chunks && (!arena || arena->try_acquire_helper())) {
+                {
+                    affinity_guard affinity(arena ? arena->cpus() : std::vector<int>());
+                    auto guard = s.ctx.install();
+                    process();
+                }
+                if (arena) {
+                    arena->release_helper();
+                }
+            }
+            s.pending_helpers.fetch_sub(1, std::memory_order_acq_rel);
+        });
+    }
+    process();
+    while (s.pending_helpers.load(std::memory_order_acquire) > 0) {
+        if (!pool.run_one()) {
+            std::this_thread::yield();
+        }
+    }
+    if (s.error) {
+        std::rethrow_exception(s.error);
+    }
+}
+
+// The number of chunks to split n items into, given the current concurrency.
+inline size_t chunk_count(size_t n, size_t grain) {
+    grain = std::max<size_t>(grain, 1);
+    size_t concurrency = task_arena::current_concurrency();
+    size_t max_chunks = (n + grain - 1) / grain;
+    return concurrency <= 1 ? std::min<size_t>(max_chunks, 1) : std::min(max_chunks, 4 * concurrency);
+}
+
+} // namespace detail
+
+// Calls f(i) for every i in [begin, end). Consecutive indices are processed in chunks of at least grain.
+template<class F> void parallel_for(size_t begin, size_t end, F&& f, size_t grain = 1) {
+    if (end <= begin) return;
+    size_t n = end - begin;
+    size_t chunks = detail::chunk_count(n, grain);
+    detail::run_chunks(chunks, [&](size_t c) {
+        size_t first = begin + n * c / chunks, last = begin + n * (c + 1) / chunks;
+        for (size_t i = first; i < last; ++i) {
+            f(i);
+        }
+    });
+}
+
+// Reduces [begin, end): body(first, last, identity) reduces a chunk and returns its result, and the
+// chunk results are combined with merge, in the order of the chunks. The result is the same as the
+// sequential one for any associative merge.
+template<class T, class Body, class Merge>
+T parallel_reduce(size_t begin, size_t end, T identity, Body&& body, Merge&& merge, size_t grain = 1) {
+    if (end <= begin) return identity;
+    size_t n = end - begin;
+    size_t chunks = detail::chunk_count(n, grain);
+    std::vector<T> results(chunks, identity);
+    detail::run_chunks(chunks, [&](size_t c) {
+        results[c] = body(begin + n * c / chunks, begin + n * (c + 1) / chunks, identity);
+    });
+    T result = std::move(results[0]);
+    for (size_t c = 1; c < chunks; ++c) {
+        result = merge(std::move(result), std::move(results[c]));
+    }
+    return result;
+}
+
+// Sorts [first, last): parts are sorted in parallel, and then merged pairwise in parallel rounds.
+template<class It, class Compare = std::less<typename std::iterator_traits<It>::value_type>>
+void parallel_sort(It first, It last, Compare comp = Compare()) {
+    size_t n = size_t(std::distance(first, last));
+    const size_t min_part = 1024;
+    size_t parts = std::min(task_arena::current_concurrency(), std::max<size_t>(n / min_part, 1));
+    if (parts <= 1) {
+        std::sort(first, last, comp);
+        return;
+    }
+    auto bound = [&](size_t p) { return first + std::ptrdiff_t(n * std::min(p, parts) / parts); };
+    detail::run_chunks(parts, [&](size_t p) {
+        std::sort(bound(p), bound(p + 1), comp);
+    });
+    for (size_t width = 1; width < parts; width *= 2) {
+        size_t merges = (parts + 2 * width - 1) / (2 * width);
+        detail::run_chunks(merges, [&](size_t m) {
+            size_t p = m * 2 * width;
+            if (p + width < parts) {
+                std::inplace_merge(bound(p), bound(p + width), bound(p + 2 * width), comp);
+            }
+        });
+    }
+}
+
+} // namespace scoped
+
+#endif // _INCLUDE_SCOPED_PARALLEL_H_
@@ -0,0 +1,435 @@
+/*
+scoped_perf.h
+
+Attributes hardware performance counters (cycles, instructions, cache misses and branch misses)
+to scoped regions.
+
+Each thread lazily opens one perf_event counter group the first time a perf_region is entered on it.
+Counters are read in user space through the perf mmap page with rdpmc where the kernel allows it, and
+with a single read() of the group otherwise. When perf events are not available at all (e.g. inside a
+container without CAP_PERFMON, or on a non-Linux platform), regions still record call counts and wall
+time from clock_gettime, and the hardware fields stay zero.
+
+Regions are identified by their tag, which must be a string with static storage duration. Deltas are
+accumulated per tag in a per-thread table, without locks or read-modify-write atomics, and
+perf_report() merges the tables of all threads (including threads that have already exited).
+
+Example:
+
+void parse(const std::string& text) {
+    scoped::perf_region region("parse");
+    ...
+}
+
+int main() {
+    ...
+    scoped::print_perf_report(std::cout);
+}
+*/
+
+#ifndef _INCLUDE_SCOPED_PERF_H_
+#define _INCLUDE_SCOPED_PERF_H_
+
+#include "scoped.h"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace scoped
+{
+
+// Counter values accumulated for a region.
+struct perf_counts {
+    uint64_t calls = 0;
+    uint64_t nanoseconds = 0;
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t cache_misses = 0;
+    uint64_t branch_misses = 0;
+
+    perf_counts& operator+=(const perf_counts& other) {
+        calls += other.calls;
+        nanoseconds += other.nanoseconds;
+        cycles += other.cycles;
+        instructions += other.instructions;
+        cache_misses += other.cache_misses;
+        branch_misses += other.branch_misses;
+        return *this;
+    }
+};
+
+// A row of perf_report(): the merged counts of all the regions sharing a tag.
+struct perf_report_entry {
+    std::string tag;
+    perf_counts counts;
+};
+
+namespace detail
+{
+
+inline uint64_t perf_clock_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000ull + uint64_t(ts.tv_nsec);
+}
+
+// A raw reading of the thread's clock and hardware counters.
+struct perf_snapshot {
+    static constexpr int num_events = 4;
+
+    uint64_t nanoseconds;
+    uint64_t hardware[num_events];
+};
+
+// The per-thread perf_event counter group. Opened once, on the first region entered by the thread.
+class perf_counter_group {
+public:
+    static constexpr int num_events = perf_snapshot::num_events;
+
+    perf_counter_group() {
+        for (int i = 0; i < num_events; ++i) {
+            m_fds[i] = -1;
+            m_pages[i] = nullptr;
+        }
+#if defined(__linux__)
+        static const uint64_t configs[num_events] = {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES,
+            PERF_COUNT_HW_BRANCH_MISSES
+        };
+        m_page_size = size_t(sysconf(_SC_PAGESIZE));
+        for (int i = 0; i < num_events; ++i) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP;
+            int group_fd = (i == 0) ? -1 : m_fds[0];
+            m_fds[i] = int(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+            if (m_fds[i] < 0) {
+                // Without a group leader there is nothing to count. A missing member only zeroes its field.
+                if (i == 0) return;
+                continue;
+            }
+            void* page = mmap(nullptr, m_page_size, PROT_READ, MAP_SHARED, m_fds[i], 0);
+            m_pages[i] = (page == MAP_FAILED) ? nullptr : page;
+        }
+        m_available = true;
+#endif
+    }
+
+    ~perf_counter_group() {
+#if defined(__linux__)
+        for (int i = num_events - 1; i >= 0; --i) {
+            if (m_pages[i]) munmap(m_pages[i], m_page_size);
+            if (m_fds[i] >= 0) close(m_fds[i]);
+        }
+#endif
+    }
+
+    perf_counter_group(const perf_counter_group&) = delete;
+    perf_counter_group& operator=(const perf_counter_group&) = delete;
+
+    // Returns whether hardware counters could be opened on this thread.
+    bool available() const { return m_available; }
+
+    void read(perf_snapshot& out) {
+        out.nanoseconds = perf_clock_ns();
+        for (int i = 0; i < num_events; ++i) {
+            out.hardware[i] = 0;
+        }
+#if defined(__linux__)
+        if (!m_available) return;
+        for (int i = 0; i < num_events; ++i) {
+            if (m_fds[i] >= 0 && !read_user(i, out.hardware[i])) {
+                read_group(out);
+                return;
+            }
+        }
+#endif
+    }
+
+private:
+#if defined(__linux__)
+    // Reads a counter through its mmap page without entering the kernel. Returns false when the
+    // kernel does not currently allow rdpmc for this counter.
+    bool read_user(int i, uint64_t& value) {
+#if defined(__x86_64__) || defined(__i386__)
+        auto pc = static_cast<volatile perf_event_mmap_page*>(m_pages[i]);
+        if (!pc) return false;
+        uint32_t seq;
+        uint64_t count;
+        do {
+            seq = pc->lock;
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+            uint32_t index = pc->index;
+            if (!pc->cap_user_rdpmc || !index) return false;
+            count = uint64_t(pc->offset);
+            uint32_t lo, hi;
+            __asm__ volatile("rdpmc" : "=a"(lo), "=d"(hi) : "c"(index - 1));
+            int shift = 64 - pc->pmc_width;
+            count += uint64_t(int64_t(((uint64_t(hi) << 32) | lo) << shift) >> shift);
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+        } while (pc->lock != seq);
+        value = count;
+        return true;
+#else
+        (void)i;
+        (void)value;
+        return false;
+#endif
+    }
+
+    // Reads the whole group with a single syscall.
+    void read_group(perf_snapshot& out) {
+        uint64_t buffer[1 + num_events] = {};
+        if (::read(m_fds[0], buffer, sizeof(buffer)) <= 0) return;
+        // Values come in creation order, without the members that failed to open.
+        for (int i = 0, k = 0; i < num_events && uint64_t(k) < buffer[0]; ++i) {
+            if (m_fds[i] >= 0) {
+                out.hardware[i] = buffer[1 + k++];
+            }
+        }
+    }
+
+    size_t m_page_size = 0;
+#endif
+
+    int m_fds[num_events];
+    void* m_pages[num_events];
+    bool m_available = false;
+};
+
+// Counts accumulated for one tag on one thread. Only the owning thread writes the fields, so
+// relaxed loads and stores are enough, and perf_report() may read them concurrently.
+struct perf_entry {
+    static constexpr int num_fields = 6;
+
+    std::atomic<const char*> tag{nullptr};
+    std::atomic<uint64_t> fields[num_fields] = {};
+
+    void add(int field, uint64_t delta) {
+        fields[field].store(fields[field].load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+    perf_counts load() const {
+        perf_counts counts;
+        counts.calls = fields[0].load(std::memory_order_relaxed);
+        counts.nanoseconds = fields[1].load(std::memory_order_relaxed);
+        counts.cycles = fields[2].load(std::memory_order_relaxed);
+        counts.instructions = fields[3].load(std::memory_order_relaxed);
+        counts.cache_misses = fields[4].load(std::memory_order_relaxed);
+        counts.branch_misses = fields[5].load(std::memory_order_relaxed);
+        return counts;
+    }
+};
+
+class perf_thread_state;
+
+// Keeps track of the live threads' tables, and of the totals of threads that already exited.
+class perf_registry {
+public:
+    static perf_registry& instance() {
+        static perf_registry s_instance;
+        return s_instance;
+    }
+
+    void attach(perf_thread_state* state) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_live.push_back(state);
+    }
+
+    inline void detach(perf_thread_state* state);
+    inline std::vector<perf_report_entry> report();
+    inline void reset();
+
+private:
+    std::mutex m_mutex;
+    std::vector<perf_thread_state*> m_live;
+    std::map<std::string, perf_counts> m_retired;
+};
+
+// Everything a thread needs to record regions: its counter group and its per-tag table.
+class perf_thread_state {
+public:
+    static constexpr size_t capacity = 256;
+
+    perf_thread_state() {
+        perf_registry::instance().attach(this);
+    }
+
+    ~perf_thread_state() {
+        perf_registry::instance().detach(this);
+    }
+
+    static perf_thread_state& instance() {
+        static thread_local perf_thread_state s_instance;
+        return s_instance;
+    }
+
+    perf_counter_group& counters() { return m_counters; }
+
+    // Returns the entry for tag, creating it if needed. Tags are compared by address, the way the
+    // same literal is normally passed from the same call site. The last slot is shared by all the
+    // tags that do not fit.
+    perf_entry& find(const char* tag) {
+        if (m_last && m_last->tag.load(std::memory_order_relaxed) == tag) {
+            return *m_last;
+        }
+        size_t size = m_size.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < size; ++i) {
+            if (m_entries[i].tag.load(std::memory_order_relaxed) == tag) {
+                return *(m_last = &m_entries[i]);
+            }
+        }
+        if (size == capacity) {
+            return m_entries[capacity - 1];
+        }
+        m_entries[size].tag.store(size == capacity - 1 ? "<other>" : tag, std::memory_order_relaxed);
+        m_size.store(size + 1, std::memory_order_release);
+        return *(m_last = &m_entries[size]);
+    }
+
+    // Calls f(tag, counts) for every entry in the table. Safe to call from any thread.
+    template<class F> void for_each(F&& f) const {
+        size_t size = m_size.load(std::memory_order_acquire);
+        for (size_t i = 0; i < size; ++i) {
+            f(m_entries[i].tag.load(std::memory_order_relaxed), m_entries[i].load());
+        }
+    }
+
+    void clear() {
+        for (size_t i = 0; i < capacity; ++i) {
+            for (auto& field : m_entries[i].fields) {
+                field.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    perf_counter_group m_counters;
+    perf_entry m_entries[capacity];
+    std::atomic<size_t> m_size{0};
+    perf_entry* m_last = nullptr;
+};
+
+inline void perf_registry::detach(perf_thread_state* state) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    state->for_each([this](const char* tag, const perf_counts& counts) {
+        m_retired[tag] += counts;
+    });
+    for (auto it = m_live.begin(); it != m_live.end(); ++it) {
+        if (*it == state) {
+            m_live.erase(it);
+            break;
+        }
+    }
+}
+
+inline std::vector<perf_report_entry> perf_registry::report() {
+    std::map<std::string, perf_counts> merged;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        merged = m_retired;
+        for (auto state : m_live) {
+            state->for_each([&merged](const char* tag, const perf_counts& counts) {
+                merged[tag] += counts;
+            });
+        }
+    }
+    std::vector<perf_report_entry> entries;
+    entries.reserve(merged.size());
+    for (auto& item : merged) {
+        entries.push_back({item.first, item.second});
+    }
+    return entries;
+}
+
+inline void perf_registry::reset() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_retired.clear();
+    for (auto state : m_live) {
+        state->clear();
+    }
+}
+
+} // namespace detail
+
+// A scoped region whose counter deltas are accumulated under its tag. Regions nest, and
+// perf_region::top() is the innermost region of the calling thread. Counts are inclusive, i.e. a
+// region's counts include the counts of the regions nested inside it.
+class perf_region : public abstract_scoped<perf_region> {
+public:
+    explicit perf_region(const char* tag) : m_tag(tag), m_state(detail::perf_thread_state::instance()) {
+        m_state.counters().read(m_start);
+    }
+
+    perf_region(const perf_region&) = delete;
+    perf_region& operator=(const perf_region&) = delete;
+
+    ~perf_region() {
+        detail::perf_snapshot end;
+        m_state.counters().read(end);
+        detail::perf_entry& entry = m_state.find(m_tag);
+        entry.add(0, 1);
+        entry.add(1, end.nanoseconds - m_start.nanoseconds);
+        for (int i = 0; i < detail::perf_snapshot::num_events; ++i) {
+            entry.add(2 + i, end.hardware[i] - m_start.hardware[i]);
+        }
+    }
+
+    perf_region& value() override { return *this; }
+
+    const char* tag() const { return m_tag; }
+
+    // Returns whether hardware counters are being collected on the calling thread.
+    static bool hardware_available() {
+        return detail::perf_thread_state::instance().counters().available();
+    }
+
+private:
+    const char* m_tag;
+    detail::perf_thread_state& m_state;
+    detail::perf_snapshot m_start;
+};
+
+// Returns the counts of all the regions recorded so far, merged across threads by tag and sorted by tag.
+inline std::vector<perf_report_entry> perf_report() {
+    return detail::perf_registry::instance().report();
+}
+
+// Clears the counts of all the regions recorded so far.
+inline void reset_perf_report() {
+    detail::perf_registry::instance().reset();
+}
+
+// Prints perf_report() as a table.
+inline void print_perf_report(std::ostream& out) {
+    out << "region\tcalls\tns\tcycles\tinstructions\tcache_misses\tbranch_misses\n";
+    for (auto& entry : perf_report()) {
+        const perf_counts& c = entry.counts;
+        out << entry.tag << '\t' << c.calls << '\t' << c.nanoseconds << '\t' << c.cycles << '\t'
+            << c.instructions << '\t' << c.cache_misses << '\t' << c.branch_misses << '\n';
+    }
+}
+
+} // namespace scoped
+
+#endif // _INCLUDE_SCOPED_PERF_H_
@@ -0,0 +1,172 @@
+/*
+scoped_reactor.h
+
+A minimal single-threaded epoll event loop whose callbacks run in the scope that registered them.
+
+Callbacks registered with reactor::add() and reactor::post() are wrapped with scoped::bind(), so they
+see the scoped values (request ids, deadlines...) that were in effect when they were registered,
+although the loop invokes them later, from its own stack, after the registering scope has exited.
+Copyable values are copied; values that cannot be copied must outlive the registration. A callback is
+stored in a single allocation, together with up to detached_context::inline_size bytes of copies.
+
+A reactor must be used from a single thread. Callbacks may add, modify and remove registrations,
+including their own, and post more callbacks.
+
+Linux only.
+
+Example:
+
+void on_readable(int fd, uint32_t events) {
+    log() << ScopedRequestId::top()->value();     // The id of the request that registered fd
+}
+
+void start_request(scoped::reactor& loop, int fd) {
+    ScopedRequestId id(next_id());
+    loop.add(fd, EPOLLIN, [fd](uint32_t events) { on_readable(fd, events); });
+}
+*/
+
+#ifndef _INCLUDE_SCOPED_REACTOR_H_
+#define _INCLUDE_SCOPED_REACTOR_H_
+
+#include "scoped_context.h"
+#include <cerrno>
+#include <cstdint>
+#include <memory>
+#include <system_error>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+namespace scoped
+{
+
+class reactor {
+public:
+    reactor() : m_epoll(::epoll_create1(EPOLL_CLOEXEC)), m_stopped(false) {
+        if (m_epoll < 0) {
+            throw std::system_error(errno, std::generic_category(), "epoll_create1");
+        }
+    }
+
+    reactor(const reactor&) = delete;
+    reactor& operator=(const reactor&) = delete;
+
+    ~reactor() {
+        ::close(m_epoll);
+    }
+
+    // Calls callback(events) when fd has any of the epoll events, with the caller's scoped values installed.
+    template<class F> void add(int fd, uint32_t events, F&& callback) {
+        std::unique_ptr<handler> h(new bound_callback<std::decay_t<F>, uint32_t>(std::forward<F>(callback)));
+        control(EPOLL_CTL_ADD, fd, events);
+        m_handlers[fd] = std::move(h);
+    }
+
+    void modify(int fd, uint32_t events) {
+        control(EPOLL_CTL_MOD, fd, events);
+    }
+
+    // Stops watching fd. Its callback is not called anymore, even for events already returned by epoll.
+    void remove(int fd) {
+        control(EPOLL_CTL_DEL, fd, 0);
+        retire(fd);
+    }
+
+    // Calls callback() from the loop, on the next iteration, with the caller's scoped values installed.
+    template<class F> void post(F&& callback) {
+        m_posted.emplace_back(new bound_callback<std::decay_t<F>>(std::forward<F>(callback)));
+    }
+
+    // Waits up to timeout_ms (forever if negative) for events, unless callbacks are posted, and
+    // dispatches them. Returns the number of callbacks called.
+    size_t run_once(int timeout_ms = -1) {
+        epoll_event events[max_events];
+        int n = ::epoll_wait(m_epoll, events, max_events, m_posted.empty() ? timeout_ms : 0);
+        if (n < 0 && errno != EINTR) {
+            throw std::system_error(errno, std::generic_category(), "epoll_wait");
+        }
+        size_t called = 0;
+        for (int i = 0; i < n; ++i) {
+            auto it = m_handlers.find(events[i].data.fd);
+            if (it != m_handlers.end()) {
+                // Removing a handler retires it, so h stays valid even if the callback removes fd.
+                handler* h = it->second.get();
+                h->call(events[i].events);
+                ++called;
+            }
+        }
+        std::vector<std::unique_ptr<posted_callback>> posted;
+        posted.swap(m_posted);
+        for (auto& callback : posted) {
+            callback->call();
+            ++called;
+        }
+        m_retired.clear();
+        return called;
+    }
+
+    // Dispatches events until stop() is called.
+    void run() {
+        m_stopped = false;
+        while (!m_stopped) {
+            run_once();
+        }
+    }
+
+    // Makes run() return after the current iteration. Must be called from the loop, e.g. by a callback.
+    void stop() { m_stopped = true; }
+
+    size_t size() const { return m_handlers.size(); }
+
+private:
+    static constexpr int max_events = 64;
+
+    // A callback, stored in one allocation together with the context captured by bind().
+    template<class ...Args> struct callback {
+        virtual ~callback() {}
+        virtual void call(Args... args) = 0;
+    };
+
+    template<class F, class ...Args> struct bound_callback : callback<Args...> {
+        template<class G> explicit bound_callback(G&& fn) : bound(bind(std::forward<G>(fn))) {}
+
+        void call(Args... args) override { bound(args...); }
+
+        bound_function<F> bound;
+    };
+
+    using handler = callback<uint32_t>;
+    using posted_callback = callback<>;
+
+    void control(int op, int fd, uint32_t events) {
+        epoll_event event = {};
+        event.events = events;
+        event.data.fd = fd;
+        if (::epoll_ctl(m_epoll, op, fd, &event) < 0) {
+            throw std::system_error(errno, std::generic_category(), "epoll_ctl");
+        }
+    }
+
+    // Unregisters the handler of fd, destroying it after the current iteration.
+    void retire(int fd) {
+        auto it = m_handlers.find(fd);
+        if (it != m_handlers.end()) {
+            m_retired.push_back(std::move(it->second));
+            m_handlers.erase(it);
+        }
+    }
+
+    int m_epoll;
+    bool m_stopped;
+    std::unordered_map<int, std::unique_ptr<handler>> m_handlers;
+    std::vector<std::unique_ptr<handler>> m_retired;
+    std::vector<std::unique_ptr<posted_callback>> m_posted;
+};
+
+} // namespace scoped
+
+#endif // _INCLUDE_SCOPED_REACTOR_H_
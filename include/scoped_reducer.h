@@ -0,0 +1,204 @@
+/*
+scoped_reducer.h
+
+Parallel reduction of scoped accumulators.
+
+A scoped::reducer<T, Merge> is an accumulator (a counter, a histogram, a set...) held by the scope that
+fans work out to other threads. Its chain is registered with scoped::context, so workers that install a
+captured context find it with reducer::top(). local() returns the calling thread's shard: the owning
+thread writes to the reducer's value directly, and every other thread gets a shard of its own, claimed
+once with an atomic increment and then found through a thread-local cache, without locks. Shards are
+padded to separate cache lines.
+
+After the workers are joined, join() merges the shards into the value, and resets them to the identity.
+The shards of threads are merged in the order they were claimed, which varies between runs: the result
+equals the sequential one for merges that are associative and do not depend on the order of the
+contributions (sums, minimums, histograms, sets). For merges that only are associative (concatenations,
+ordered lists), work items pass their index to local(index) instead, e.g. the index of their chunk. Such
+shards are merged in the order of their indices, so the result is the sequential one when the items are
+consecutive ranges of the work, each processed in order. Indices below the number of shards are
+located without locking.
+
+Example:
+
+using counter = scoped::reducer<long>;
+
+void visit(const node& n) {
+    counter::top()->value().local() += n.size;
+}
+
+long total_size(const std::vector<node>& nodes) {
+    counter total;
+    auto ctx = scoped::context::capture();
+    run_in_parallel(nodes, [&ctx](const node& n) {
+        auto guard = ctx.install();
+        visit(n);
+    });
+    return total.get();
+}
+*/
+
+#ifndef _INCLUDE_SCOPED_REDUCER_H_
+#define _INCLUDE_SCOPED_REDUCER_H_
+
+#include "scoped_context.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace scoped
+{
+
+template<class T, class Merge = std::plus<T>> class reducer : public abstract_scoped<reducer<T, Merge>> {
+public:
+    using abstract = abstract_scoped<reducer<T, Merge>>;
+
+    // Merge(a, b) returns the combination of a and b. Shards start as copies of identity.
+    explicit reducer(T identity = T(), Merge merge = Merge(), size_t shards = default_shards()) :
+        m_identity(identity), m_merge(std::move(merge)), m_value(std::move(identity)),
+        m_owner(thread_marker()), m_id(next_id()), m_capacity(shards ? shards : 1),
+        m_shards(new shard[m_capacity]), m_indexed(new shard[m_capacity]), m_claimed(0) {
+        (void)s_propagated;
+        for (size_t i = 0; i < m_capacity; ++i) {
+            m_shards[i].value = m_identity;
+            m_indexed[i].value = m_identity;
+        }
+    }
+
+    reducer(const reducer&) = delete;
+    reducer& operator=(const reducer&) = delete;
+
+    reducer& value() override { return *this; }
+
+    // Returns the value the calling thread accumulates into.
+    T& local() {
+        if (thread_marker() == m_owner) {
+            return m_value;
+        }
+        auto& cache = thread_cache();
+        for (auto& item : cache.items) {
+            if (item.id == m_id) {
+                return *item.value;
+            }
+        }
+        T* value = claim();
+        cache.items[cache.next++ % thread_cache_size] = {m_id, value};
+        return *value;
+    }
+
+    // Returns the value the work item with the given index accumulates into, from any thread. Items
+    // with the same index must not run concurrently.
+    T& local(size_t index) {
+        if (index < m_capacity) {
+            return m_indexed[index].value;
+        }
+        std::lock_guard<std::mutex> lock(m_overflow_mutex);
+        return m_indexed_overflow.emplace(index, m_identity).first->second;
+    }
+
+    // Merges the shards into the value, and resets them: the shards of work items in the order of their
+    // indices, then the shards of threads. Must be called by the owning thread, once the workers are done.
+    void join() {
+        for (size_t i = 0; i < m_capacity; ++i) {
+            m_value = m_merge(std::move(m_value), m_indexed[i].value);
+            m_indexed[i].value = m_identity;
+        }
+        std::lock_guard<std::mutex> lock(m_overflow_mutex);
+        for (auto& item : m_indexed_overflow) {
+            m_value = m_merge(std::move(m_value), item.second);
+        }
+        m_indexed_overflow.clear();
+        size_t claimed = m_claimed.load(std::memory_order_acquire);
+        for (size_t i = 0; i < claimed && i < m_capacity; ++i) {
+            m_value = m_merge(std::move(m_value), m_shards[i].value);
+            m_shards[i].value = m_identity;
+        }
+        for (auto& s : m_overflow) {
+            m_value = m_merge(std::move(m_value), s.value);
+            s.value = m_identity;
+        }
+    }
+
+    // Joins, and returns the value.
+    T& get() {
+        join();
+        return m_value;
+    }
+
+    static size_t default_shards() {
+        return 2 * std::max(1u, std::thread::hardware_concurrency());
+    }
+
+private:
+    struct alignas(64) shard {
+        T value;
+    };
+
+    struct cache_item {
+        uint64_t id;
+        T* value;
+    };
+
+    static constexpr size_t thread_cache_size = 4;
+
+    struct cache {
+        cache_item items[thread_cache_size] = {};
+        size_t next = 0;
+    };
+
+    // Identifies the calling thread.
+    static const void* thread_marker() {
+        static thread_local char s_marker;
+        return &s_marker;
+    }
+
+    // The last shards the calling thread used, by reducer id. Ids are never reused, unlike addresses.
+    static cache& thread_cache() {
+        static thread_local cache s_cache;
+        return s_cache;
+    }
+
+    static uint64_t next_id() {
+        static std::atomic<uint64_t> s_next_id(1);
+        return s_next_id.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    T* claim() {
+        size_t index = m_claimed.fetch_add(1, std::memory_order_acq_rel);
+        if (index < m_capacity) {
+            return &m_shards[index].value;
+        }
+        // More threads than shards: take one from the overflow list, which is only locked to claim.
+        std::lock_guard<std::mutex> lock(m_overflow_mutex);
+        m_overflow.push_back(shard{m_identity});
+        return &m_overflow.back().value;
+    }
+
+    T m_identity;
+    Merge m_merge;
+    T m_value;
+    const void* m_owner;
+    uint64_t m_id;
+    size_t m_capacity;
+    std::unique_ptr<shard[]> m_shards;
+    std::unique_ptr<shard[]> m_indexed;
+    std::atomic<size_t> m_claimed;
+    std::mutex m_overflow_mutex;
+    std::deque<shard> m_overflow;
+    std::map<size_t, T> m_indexed_overflow;
+
+    static const bool s_propagated;
+};
+
+template<class T, class Merge>
+const bool reducer<T, Merge>::s_propagated = context::propagate<reducer<T, Merge>>();
+
+} // namespace scoped
+
+#endif // _INCLUDE_SCOPED_REDUCER_H_
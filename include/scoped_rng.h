@@ -0,0 +1,183 @@
+/*
+scoped_rng.h
+
+Deterministic random streams for reproducible parallel simulation.
+
+A scoped::rng is a counter-based Philox4x32-10 generator. Each rng derives its key from the key of the
+enclosing rng (its parent in the chain) and a key chosen by the scope, so the numbers a scope draws
+depend only on the path of keys leading to it, and not on which thread runs it or in which order.
+
+The rng chain is registered with scoped::context, so tasks that install a captured context see the rng
+of the scope that created them. An rng must not be drawn from by several threads at once: each task
+should derive its own child rng, keyed by e.g. its task index, and draw from that.
+
+Drawing many numbers at once with fill() generates several Philox blocks side by side, which compilers
+vectorize.
+
+Example:
+
+void simulate(int path) {
+    scoped::rng rng(path);            // Derived from the caller's rng, keyed by path
+    double x = rng.uniform();
+    ...
+}
+
+int main() {
+    scoped::rng root(42);             // The seed of the whole simulation
+    parallel_for(0, paths, simulate);
+}
+*/
+
+#ifndef _INCLUDE_SCOPED_RNG_H_
+#define _INCLUDE_SCOPED_RNG_H_
+
+#include "scoped_context.h"
+#include <cstdint>
+
+namespace scoped
+{
+
+namespace detail
+{
+
+// One Philox4x32-10 block: encrypts counter ctr with key.
+inline void philox4x32(uint32_t ctr[4], uint32_t key0, uint32_t key1) {
+    for (int round = 0; round < 10; ++round) {
+        uint64_t p0 = uint64_t(0xD2511F53u) * ctr[0];
+        uint64_t p1 = uint64_t(0xCD9E8D57u) * ctr[2];
+        uint32_t x0 = uint32_t(p1 >> 32) ^ ctr[1] ^ key0;
+        uint32_t x1 = uint32_t(p1);
+        uint32_t x2 = uint32_t(p0 >> 32) ^ ctr[3] ^ key1;
+        uint32_t x3 = uint32_t(p0);
+        ctr[0] = x0; ctr[1] = x1; ctr[2] = x2; ctr[3] = x3;
+        key0 += 0x9E3779B9u;
+        key1 += 0xBB67AE85u;
+    }
+}
+
+} // namespace detail
+
+class rng : public abstract_scoped<rng> {
+public:
+    // Creates a stream keyed by key and the key of the enclosing rng, if any.
+    explicit rng(uint64_t key) : m_counter(0), m_available(0) {
+        uint64_t parent = next() ? next()->value().key() : 0;
+        uint32_t block[4] = {uint32_t(key), uint32_t(key >> 32), 0x5CA1AB1Eu, 0x0DE7E511u};
+        detail::philox4x32(block, uint32_t(parent), uint32_t(parent >> 32));
+        m_key = uint64_t(block[0]) | (uint64_t(block[1]) << 32);
+    }
+
+    rng(const rng&) = delete;
+    rng& operator=(const rng&) = delete;
+
+    rng& value() override { return *this; }
+
+    // The key of this stream, from which nested streams are derived.
+    uint64_t key() const { return m_key; }
+
+    uint32_t next_u32() {
+        if (!m_available) {
+            refill();
+        }
+        return m_buffer[4 - m_available--];
+    }
+
+    uint64_t next_u64() {
+        uint64_t lo = next_u32();
+        return lo | (uint64_t(next_u32()) << 32);
+    }
+
+    // Returns a double uniformly distributed in [0, 1).
+    double uniform() {
+        return double(next_u64() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    // Fills out with n random numbers. For a given stream, the sequence is the same as drawing them
+    // one by one with next_u32().
+    void fill(uint32_t* out, size_t n) {
+        while (n && m_available) {
+            *out++ = next_u32();
+            --n;
+        }
+        constexpr size_t lanes = 8;
+        uint32_t key0 = uint32_t(m_key), key1 = uint32_t(m_key >> 32);
+        while (n >= 4 * lanes) {
+            // Structure of arrays, so that the rounds of all lanes are computed together.
+            uint32_t c0[lanes], c1[lanes], c2[lanes], c3[lanes];
+            for (size_t l = 0; l < lanes; ++l) {
+                c0[l] = uint32_t(m_counter + l);
+                c1[l] = uint32_t((m_counter + l) >> 32);
+                c2[l] = 0;
+                c3[l] = 0;
+            }
+            uint32_t k0 = key0, k1 = key1;
+            for (int round = 0; round < 10; ++round) {
+                for (size_t l = 0; l < lanes; ++l) {
+                    uint64_t p0 = uint64_t(0xD2511F53u) * c0[l];
+                    uint64_t p1 = uint64_t(0xCD9E8D57u) * c2[l];
+                    uint32_t x0 = uint32_t(p1 >> 32) ^ c1[l] ^ k0;
+                    uint32_t x2 = uint32_t(p0 >> 32) ^ c3[l] ^ k1;
+                    c1[l] = uint32_t(p1);
+                    c3[l] = uint32_t(p0);
+                    c0[l] = x0;
+                    c2[l] = x2;
+                }
+                k0 += 0x9E3779B9u;
+                k1 += 0xBB67AE85u;
+            }
+            for (size_t l = 0; l < lanes; ++l) {
+                out[4 * l + 0] = c0[l];
+                out[4 * l + 1] = c1[l];
+                out[4 * l + 2] = c2[l];
+                out[4 * l + 3] = c3[l];
+            }
+            m_counter += lanes;
+            out += 4 * lanes;
+            n -= 4 * lanes;
+        }
+        while (n--) {
+            *out++ = next_u32();
+        }
+    }
+
+    // Fills out with n doubles uniformly distributed in [0, 1).
+    void fill_uniform(double* out, size_t n) {
+        constexpr size_t chunk = 256;
+        uint32_t bits[2 * chunk];
+        while (n) {
+            size_t count = n < chunk ? n : chunk;
+            fill(bits, 2 * count);
+            for (size_t i = 0; i < count; ++i) {
+                uint64_t u = uint64_t(bits[2 * i]) | (uint64_t(bits[2 * i + 1]) << 32);
+                out[i] = double(u >> 11) * (1.0 / 9007199254740992.0);
+            }
+            out += count;
+            n -= count;
+        }
+    }
+
+private:
+    void refill() {
+        m_buffer[0] = uint32_t(m_counter);
+        m_buffer[1] = uint32_t(m_counter >> 32);
+        m_buffer[2] = 0;
+        m_buffer[3] = 0;
+        detail::philox4x32(m_buffer, uint32_t(m_key), uint32_t(m_key >> 32));
+        ++m_counter;
+        m_available = 4;
+    }
+
+    uint64_t m_key;
+    uint64_t m_counter;
+    uint32_t m_buffer[4];
+    unsigned m_available;
+};
+
+namespace detail
+{
+inline const bool rng_propagated = context::propagate<rng>();
+}
+
+} // namespace scoped
+
+#endif // _INCLUDE_SCOPED_RNG_H_
@@ -0,0 +1,244 @@
+/*
+scoped_shm.h
+
+Values shared by the processes of a machine through POSIX shared memory, published with a seqlock.
+
+A scoped::shm_global<T> refers to a shared memory segment holding a trivially copyable T, e.g. a struct of
+tuning knobs. Any process can store() a new value; readers load() a consistent copy without system
+calls or locks, retrying only when they overlap a store. snapshot() takes such a copy into a scoped
+instance, scoped<T, Tags...>, typically at the start of a request, so that the request sees one
+version of the value throughout.
+
+The segment is created, zero-filled, by the first process that opens it, and removed with unlink().
+Its header records the size of the value, so that processes built with a different T fail to open it.
+shm_segment gives untyped access to the same segments, e.g. for the scoped_shm_write tool.
+
+Linux and other POSIX systems only; link with -lrt on old glibc versions.
+
+Example:
+
+struct knobs {
+    uint32_t batch_size;
+    double sample_rate;
+};
+using Knobs = scoped::scoped<knobs, struct KnobsTag>;
+
+scoped::shm_global<knobs, struct KnobsTag> g_knobs("/service_knobs");
+
+void handle_request() {
+    auto knobs = g_knobs.snapshot();            // One consistent copy for the whole request
+    ...
+    size_t n = Knobs::top()->value().batch_size;
+}
+*/
+
+#ifndef _INCLUDE_SCOPED_SHM_H_
+#define _INCLUDE_SCOPED_SHM_H_
+
+#include "scoped.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace scoped
+{
+
+// A shared memory segment holding value_size bytes, read and written under a seqlock.
+class shm_segment {
+public:
+    // Opens the segment called name, creating it if create is true and it does not exist. value_size is
+    // the size of the value, or 0 to take it from an existing segment. Throws a std::system_error if the
+    // segment cannot be opened, and a std::runtime_error if its value has another size.
+    shm_segment(const std::string& name, size_t value_size, bool create = true) :
+        m_header(nullptr), m_mapped_size(0) {
+        int fd = ::shm_open(name.c_str(), O_RDWR | (create ? O_CREAT : 0), 0666);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "shm_open " + name);
+        }
+        struct stat st;
+        if (::fstat(fd, &st) < 0) {
+            fail(fd, "fstat " + name);
+        }
+        if (!value_size) {
+            if (size_t(st.st_size) < sizeof(header)) {
+                ::close(fd);
+                throw std::runtime_error(name + ": not an initialized shared memory segment");
+            }
+            header h;
+            if (::pread(fd, &h, sizeof(h), 0) != ssize_t(sizeof(h)) || !h.value_size) {
+                ::close(fd);
+                throw std::runtime_error(name + ": not an initialized shared memory segment");
+            }
+            value_size = h.value_size;
+        }
+        size_t words = (value_size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+        m_mapped_size = sizeof(header) + words * sizeof(uint64_t);
+        // Every process extends the segment to the same size, so the order of the openers does not matter.
+        if (size_t(st.st_size) < m_mapped_size && ::ftruncate(fd, off_t(m_mapped_size)) < 0) {
+            fail(fd, "ftruncate " + name);
+        }
+        void* memory = ::mmap(nullptr, m_mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (memory == MAP_FAILED) {
+            fail(fd, "mmap " + name);
+        }
+        ::close(fd);
+        m_header = static_cast<header*>(memory);
+        uint64_t expected = 0;
+        if (!m_header->value_size.compare_exchange_strong(expected, value_size) && expected != value_size) {
+            ::munmap(memory, m_mapped_size);
+            throw std::runtime_error(name + ": shared value has size " + std::to_string(expected) +
+                ", expected " + std::to_string(value_size));
+        }
+        m_value_size = value_size;
+    }
+
+    shm_segment(const shm_segment&) = delete;
+    shm_segment& operator=(const shm_segment&) = delete;
+
+    ~shm_segment() {
+        if (m_header) {
+            ::munmap(m_header, m_mapped_size);
+        }
+    }
+
+    size_t value_size() const { return m_value_size; }
+
+    // The number of stores so far. Readers can compare versions to skip copies of unchanged values.
+    uint64_t version() const { return m_header->sequence.load(std::memory_order_acquire) / 2; }
+
+    // Copies the value to out, without locking. Retries while a store is in progress.
+    void read(void* out) const {
+        unsigned char* bytes = static_cast<unsigned char*>(out);
+        for (unsigned spins = 0;; ++spins) {
+            uint64_t before = m_header->sequence.load(std::memory_order_acquire);
+            if (!(before & 1)) {
+                copy_out(bytes);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (m_header->sequence.load(std::memory_order_relaxed) == before) return;
+            }
+            if (spins > 100) std::this_thread::yield();
+        }
+    }
+
+    // Replaces size bytes of the value at offset. Concurrent writers are serialized by the seqlock.
+    void write(const void* data, size_t size, size_t offset = 0) {
+        if (offset > m_value_size || size > m_value_size - offset) {
+            throw std::out_of_range("shm_segment::write beyond the value");
+        }
+        uint64_t sequence = lock();
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = offset / sizeof(uint64_t); i * sizeof(uint64_t) < offset + size; ++i) {
+            unsigned char word[sizeof(uint64_t)];
+            uint64_t current = words()[i].load(std::memory_order_relaxed);
+            std::memcpy(word, &current, sizeof(word));
+            for (size_t b = 0; b < sizeof(word); ++b) {
+                size_t position = i * sizeof(uint64_t) + b;
+                if (position >= offset && position < offset + size) {
+                    word[b] = bytes[position - offset];
+                }
+            }
+            std::memcpy(&current, word, sizeof(word));
+            words()[i].store(current, std::memory_order_relaxed);
+        }
+        m_header->sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    // Removes the segment called name. Processes that opened it keep their mapping.
+    static bool unlink(const std::string& name) {
+        return ::shm_unlink(name.c_str()) == 0;
+    }
+
+private:
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared atomics must be lock-free");
+
+    struct header {
+        std::atomic<uint64_t> sequence;
+        std::atomic<uint64_t> value_size;
+    };
+
+    [[noreturn]] static void fail(int fd, const std::string& what) {
+        int error = errno;
+        ::close(fd);
+        throw std::system_error(error, std::generic_category(), what);
+    }
+
+    std::atomic<uint64_t>* words() const {
+        return reinterpret_cast<std::atomic<uint64_t>*>(m_header + 1);
+    }
+
+    // Copies the words of the value with relaxed atomic loads, which may race with a store.
+    void copy_out(unsigned char* out) const {
+        size_t i = 0;
+        for (; (i + 1) * sizeof(uint64_t) <= m_value_size; ++i) {
+            uint64_t word = words()[i].load(std::memory_order_relaxed);
+            std::memcpy(out + i * sizeof(uint64_t), &word, sizeof(word));
+        }
+        if (i * sizeof(uint64_t) < m_value_size) {
+            uint64_t word = words()[i].load(std::memory_order_relaxed);
+            std::memcpy(out + i * sizeof(uint64_t), &word, m_value_size - i * sizeof(uint64_t));
+        }
+    }
+
+    // Makes the sequence odd, waiting for concurrent writers. Returns the even sequence it replaced.
+    uint64_t lock() {
+        for (unsigned spins = 0;; ++spins) {
+            uint64_t sequence = m_header->sequence.load(std::memory_order_relaxed);
+            if (!(sequence & 1) && m_header->sequence.compare_exchange_weak(sequence, sequence + 1, std::memory_order_acquire)) {
+                std::atomic_thread_fence(std::memory_order_release);
+                return sequence;
+            }
+            if (spins > 100) std::this_thread::yield();
+        }
+    }
+
+    header* m_header;
+    size_t m_mapped_size;
+    size_t m_value_size;
+};
+
+template<class T, class ...Tags> class shm_global {
+    static_assert(std::is_trivially_copyable<T>::value, "shm_global values must be trivially copyable");
+
+public:
+    // The scoped instances that hold snapshots of the value.
+    using scope = scoped<T, Tags...>;
+
+    explicit shm_global(const std::string& name) : m_segment(name, sizeof(T)) {}
+
+    // Returns a consistent copy of the value, without system calls or locks.
+    T load() const {
+        T value;
+        m_segment.read(&value);
+        return value;
+    }
+
+    // Publishes a new value to all the processes.
+    void store(const T& value) {
+        m_segment.write(&value, sizeof(T));
+    }
+
+    // Returns a scoped instance holding a consistent copy of the value.
+    scope snapshot() const {
+        return scope(load());
+    }
+
+    uint64_t version() const { return m_segment.version(); }
+
+private:
+    shm_segment m_segment;
+};
+
+} // namespace scoped
+
+#endif // _INCLUDE_SCOPED_SHM_H_
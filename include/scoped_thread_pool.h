@@ -0,0 +1,102 @@
+/*
+scoped_thread_pool.h
+
+A shared pool of worker threads, used by the parallel algorithms and other helpers of the library.
+
+Tasks are plain callables. They do not see the scoped values of the thread that submitted them, unless
+they install a scoped::context captured by the submitter. Threads waiting for tasks they depend on can
+call run_one() to execute pending tasks instead of blocking, which avoids deadlocks and
+oversubscription when parallel work nests.
+*/
+
+#ifndef _INCLUDE_SCOPED_THREAD_POOL_H_
+#define _INCLUDE_SCOPED_THREAD_POOL_H_
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace scoped
+{
+
+class thread_pool {
+public:
+    explicit thread_pool(size_t threads) : m_stopping(false) {
+        for (size_t i = 0; i < threads; ++i) {
+            m_threads.emplace_back([this] { work(); });
+        }
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    // Runs the tasks already submitted, then joins the threads.
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_wakeup.notify_all();
+        for (auto& t : m_threads) {
+            t.join();
+        }
+    }
+
+    // The pool shared by the library, with a thread per hardware thread.
+    static thread_pool& instance() {
+        static thread_pool s_instance(std::max(1u, std::thread::hardware_concurrency()));
+        return s_instance;
+    }
+
+    size_t size() const { return m_threads.size(); }
+
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tasks.push_back(std::move(task));
+        }
+        m_wakeup.notify_one();
+    }
+
+    // Runs one pending task on the calling thread. Returns false if there was none.
+    bool run_one() {
+        std::function<void()> task;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_tasks.empty()) return false;
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        task();
+        return true;
+    }
+
+private:
+    void work() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wakeup.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+                if (m_tasks.empty()) return;
+                task = std::move(m_tasks.front());
+                m_tasks.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+    std::deque<std::function<void()>> m_tasks;
+    std::vector<std::thread> m_threads;
+    bool m_stopping;
+};
+
+} // namespace scoped
+
+#endif // _INCLUDE_SCOPED_THREAD_POOL_H_
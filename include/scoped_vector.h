@@ -0,0 +1,209 @@
+/*
+scoped_vector.h
+
+A vector of scoped values, which relinks its elements in bulk when it grows.
+
+Each element of a scoped::scoped_vector<T, Tags...> is a scoped instance of abstract_scoped<T, Tags...>,
+pushed on the calling thread when it is added, like the elements of std::vector<scoped<T, Tags...>>.
+When std::vector reallocates, it moves its elements one by one, and every move inserts the new instance
+and detaches the old one. scoped_vector instead moves the values into detached instances, and then moves
+the links of the whole block at once: links between elements are translated to the new block, and only
+the instances around the block are relinked. The elements keep their places in the chain, including
+around instances created between them. Moving the whole vector does not move its elements.
+
+Like other scoped instances, the elements belong to the thread that added them.
+
+Example:
+
+using Feature = scoped::scoped<std::string, struct FeatureTag>;
+
+void handle_request(const std::vector<std::string>& flags) {
+    scoped::scoped_vector<std::string, struct FeatureTag> features;
+    features.reserve(flags.size());
+    for (auto& flag : flags) {
+        features.emplace_back(flag);                // Feature::top() is the last flag
+    }
+    ...
+}
+*/
+
+#ifndef _INCLUDE_SCOPED_VECTOR_H_
+#define _INCLUDE_SCOPED_VECTOR_H_
+
+#include "scoped.h"
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace scoped
+{
+
+template<class T, class ...Tags> class scoped_vector {
+public:
+    using abstract = abstract_scoped<T, Tags...>;
+    using value_type = T;
+
+    scoped_vector() : m_nodes(nullptr), m_size(0), m_capacity(0) {}
+
+    scoped_vector(const scoped_vector&) = delete;
+    scoped_vector& operator=(const scoped_vector&) = delete;
+
+    // Takes over the elements of other, which stay where they are.
+    scoped_vector(scoped_vector&& other) noexcept :
+        m_nodes(std::exchange(other.m_nodes, nullptr)),
+        m_size(std::exchange(other.m_size, 0)),
+        m_capacity(std::exchange(other.m_capacity, 0)) {}
+
+    scoped_vector& operator=(scoped_vector&& other) noexcept {
+        if (this != &other) {
+            clear();
+            deallocate(m_nodes, m_capacity);
+            m_nodes = std::exchange(other.m_nodes, nullptr);
+            m_size = std::exchange(other.m_size, 0);
+            m_capacity = std::exchange(other.m_capacity, 0);
+        }
+        return *this;
+    }
+
+    ~scoped_vector() {
+        clear();
+        deallocate(m_nodes, m_capacity);
+    }
+
+    size_t size() const { return m_size; }
+    size_t capacity() const { return m_capacity; }
+    bool empty() const { return m_size == 0; }
+
+    T& operator[](size_t i) { return m_nodes[i].value(); }
+    const T& operator[](size_t i) const { return m_nodes[i].m_value; }
+
+    T& at(size_t i) {
+        if (i >= m_size) throw std::out_of_range("scoped_vector::at");
+        return m_nodes[i].value();
+    }
+
+    T& front() { return m_nodes[0].value(); }
+    T& back() { return m_nodes[m_size - 1].value(); }
+
+    // The scoped instance of element i.
+    abstract& node(size_t i) { return m_nodes[i]; }
+
+    // Makes room for capacity elements, relinking the existing ones in bulk.
+    void reserve(size_t capacity) {
+        if (capacity <= m_capacity) return;
+        node_type* nodes = allocate(capacity);
+        try {
+            move_to(nodes, capacity);
+        }
+        catch (...) {
+            deallocate(nodes, capacity);
+            throw;
+        }
+    }
+
+    // Adds an element constructed from args, on top of the chain. Args may refer to elements of the vector.
+    template<class ...Args> T& emplace_back(Args&&... args) {
+        if (m_size < m_capacity) {
+            ::new (static_cast<void*>(m_nodes + m_size)) node_type(std::forward<Args>(args)...);
+            return m_nodes[m_size++].value();
+        }
+        // Construct the new element before the others are moved out of the storage args may refer to.
+        size_t capacity = std::max<size_t>(2 * m_capacity, 4);
+        node_type* nodes = allocate(capacity);
+        try {
+            ::new (static_cast<void*>(nodes + m_size)) node_type(std::forward<Args>(args)...);
+            try {
+                move_to(nodes, capacity);
+            }
+            catch (...) {
+                nodes[m_size].~node_type();
+                throw;
+            }
+        }
+        catch (...) {
+            deallocate(nodes, capacity);
+            throw;
+        }
+        return m_nodes[m_size++].value();
+    }
+
+    void push_back(const T& value) { emplace_back(value); }
+    void push_back(T&& value) { emplace_back(std::move(value)); }
+
+    void pop_back() {
+        m_nodes[--m_size].~node_type();
+    }
+
+    void clear() {
+        destroy(m_nodes, m_size);
+        m_size = 0;
+    }
+
+private:
+    struct detached_t {};
+    static constexpr detached_t detached{};
+
+    class node_type : public abstract {
+    public:
+        template<class ...Args> explicit node_type(Args&&... args) : abstract(), m_value{std::forward<Args>(args)...} {
+            this->set_type(type_id<T>());
+        }
+
+        template<class V> node_type(detached_t, V&& value) :
+            abstract(typename abstract::detached_t()), m_value(std::forward<V>(value)) {
+            this->set_type(type_id<T>());
+        }
+
+        T& value() override { return m_value; }
+
+        T m_value;
+    };
+
+    // Moves the elements to nodes, which has room for capacity elements, relinking them in bulk, and frees
+    // the current storage. Leaves the vector unchanged if moving a value throws.
+    void move_to(node_type* nodes, size_t capacity) {
+        size_t moved = 0;
+        try {
+            for (; moved < m_size; ++moved) {
+                ::new (static_cast<void*>(nodes + moved)) node_type(detached, std::move_if_noexcept(m_nodes[moved].m_value));
+            }
+        }
+        catch (...) {
+            destroy(nodes, moved);
+            throw;
+        }
+        if (m_size) {
+            abstract::relocate(m_nodes, nodes, m_size, sizeof(node_type));
+        }
+        destroy(m_nodes, m_size);
+        deallocate(m_nodes, m_capacity);
+        m_nodes = nodes;
+        m_capacity = capacity;
+    }
+
+    static node_type* allocate(size_t n) {
+        return std::allocator<node_type>().allocate(n);
+    }
+
+    static void deallocate(node_type* nodes, size_t n) {
+        if (nodes) std::allocator<node_type>().deallocate(nodes, n);
+    }
+
+    // Destroys the nodes from the last, which is usually on top of the chain.
+    static void destroy(node_type* nodes, size_t n) {
+        while (n) {
+            nodes[--n].~node_type();
+        }
+    }
+
+    node_type* m_nodes;
+    size_t m_size;
+    size_t m_capacity;
+};
+
+} // namespace scoped
+
+#endif // _INCLUDE_SCOPED_VECTOR_H_
@@ -0,0 +1,314 @@
+/*
+scoped_wire.h
+
+Ships scoped values to other processes, in a compact binary header.
+
+Scoped types take part once they are registered with wire::propagate<S>(id), where id identifies the type
+across the processes, and S is a scoped<> type whose value type has wire_traits: arithmetic types, enums,
+std::string and std::string_view are supported, and other types can specialize wire_traits.
+
+wire::encode() appends the current values of the registered types on the calling thread to a buffer:
+
+    'S' 'W' version count size:u32 | id:u16 length:u16 payload | id:u16 length:u16 payload | ...
+
+where size is the size of the entries, and integers are little-endian. wire::install() decodes a header
+in place, from the receive buffer, and pushes the values as scoped instances on the calling thread for
+the lifetime of the returned guard. String views point into the buffer, which must outlive the guard.
+Entries of unknown ids are skipped, so that processes can be upgraded one at a time.
+
+Example:
+
+using Tenant = scoped::scoped<std::string_view, struct TenantTag>;
+static const bool tenant_shipped = scoped::wire::propagate<Tenant>(1);
+
+void send_work(int fd, const std::string& payload) {
+    std::string message;
+    scoped::wire::encode(message);
+    message += payload;
+    write(fd, message.data(), message.size());
+}
+
+void receive_work(const char* data, size_t size) {
+    size_t header_size;
+    auto guard = scoped::wire::install(data, size, &header_size);
+    process(data + header_size, size - header_size);        // Tenant::top() is the sender's tenant
+}
+*/
+
+#ifndef _INCLUDE_SCOPED_WIRE_H_
+#define _INCLUDE_SCOPED_WIRE_H_
+
+#include "scoped_context.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace scoped
+{
+
+class wire_error : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// How values of type T are encoded: encode() appends the payload, decode() reads it and returns false if
+// it is malformed. Decoding may refer to the payload, which outlives the decoded value.
+template<class T, class Enable = void> struct wire_traits;
+
+template<class T> struct wire_traits<T, std::enable_if_t<std::is_arithmetic<T>::value || std::is_enum<T>::value>> {
+    static void encode(const T& value, std::string& out) {
+        unsigned char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        if (!little_endian()) {
+            std::reverse(bytes, bytes + sizeof(T));
+        }
+        out.append(reinterpret_cast<const char*>(bytes), sizeof(T));
+    }
+
+    static bool decode(const char* data, size_t size, T& value) {
+        if (size != sizeof(T)) return false;
+        unsigned char bytes[sizeof(T)];
+        std::memcpy(bytes, data, sizeof(T));
+        if (!little_endian()) {
+            std::reverse(bytes, bytes + sizeof(T));
+        }
+        std::memcpy(&value, bytes, sizeof(T));
+        return true;
+    }
+
+    static bool little_endian() {
+        const uint16_t one = 1;
+        return *reinterpret_cast<const unsigned char*>(&one) == 1;
+    }
+};
+
+template<> struct wire_traits<std::string_view> {
+    static void encode(std::string_view value, std::string& out) { out.append(value.data(), value.size()); }
+
+    static bool decode(const char* data, size_t size, std::string_view& value) {
+        value = std::string_view(data, size);
+        return true;
+    }
+};
+
+template<> struct wire_traits<std::string> {
+    static void encode(const std::string& value, std::string& out) { out += value; }
+
+    static bool decode(const char* data, size_t size, std::string& value) {
+        value.assign(data, size);
+        return true;
+    }
+};
+
+class wire {
+    // How to encode a registered type, and construct its instances.
+    struct type {
+        uint16_t id;
+        bool (*encode)(std::string& out);
+        bool (*construct)(void* where, const char* data, size_t size);
+        void (*destroy)(void* node);
+        size_t node_size;
+        size_t node_align;
+    };
+
+public:
+    static constexpr uint8_t version = 1;
+    static constexpr size_t header_size = 8;
+    static constexpr size_t entry_header_size = 4;
+
+    // Registers the scoped type S under id, which must be the same in all the processes. Returns true,
+    // so that it can initialize a static variable.
+    template<class S> static bool propagate(uint16_t id) {
+        using A = typename S::abstract;
+        using V = std::remove_cv_t<typename A::value_type>;
+        type t;
+        t.id = id;
+        t.encode = [](std::string& out) {
+            A* top = A::top();
+            if (!top) return false;
+            wire_traits<V>::encode(top->value(), out);
+            return true;
+        };
+        t.construct = [](void* where, const char* data, size_t size) {
+            V value;
+            if (!wire_traits<V>::decode(data, size, value)) return false;
+            ::new (where) S(std::move(value));
+            return true;
+        };
+        t.destroy = [](void* node) {
+            static_cast<S*>(node)->~S();
+        };
+        t.node_size = sizeof(S);
+        t.node_align = alignof(S);
+        std::lock_guard<std::mutex> lock(registry_mutex());
+        for (auto& other : registry()) {
+            if (other.id == id) {
+                throw wire_error("wire id " + std::to_string(id) + " registered twice");
+            }
+        }
+        registry().push_back(t);
+        return true;
+    }
+
+    // Appends a header with the current values of the registered types on the calling thread to out.
+    static void encode(std::string& out) {
+        size_t start = out.size();
+        out.append(header_size, '\0');
+        uint8_t count = 0;
+        for (auto& t : registry()) {
+            size_t entry = out.size();
+            out.append(entry_header_size, '\0');
+            if (!t.encode(out)) {
+                out.resize(entry);
+                continue;
+            }
+            size_t length = out.size() - entry - entry_header_size;
+            if (length > UINT16_MAX || count == UINT8_MAX) {
+                throw wire_error("scoped value too large to encode");
+            }
+            put16(&out[entry], t.id);
+            put16(&out[entry + 2], uint16_t(length));
+            ++count;
+        }
+        out[start] = 'S';
+        out[start + 1] = 'W';
+        out[start + 2] = char(version);
+        out[start + 3] = char(count);
+        put32(&out[start + 4], uint32_t(out.size() - start - header_size));
+    }
+
+    // The scoped instances decoded from a header, pushed on the calling thread for the lifetime of the guard.
+    class guard {
+    public:
+        guard(const char* data, size_t size, size_t* consumed) : m_constructed(0) {
+            if (size < header_size || data[0] != 'S' || data[1] != 'W') {
+                throw wire_error("missing scoped wire header");
+            }
+            if (uint8_t(data[2]) != version) {
+                throw wire_error("unsupported scoped wire version");
+            }
+            size_t count = uint8_t(data[3]);
+            size_t body = get32(data + 4);
+            if (body > size - header_size) {
+                throw wire_error("truncated scoped wire header");
+            }
+            if (consumed) {
+                *consumed = header_size + body;
+            }
+            auto& types = registry();
+
+            // Find the types of the entries, and where to construct their instances.
+            const char* p = data + header_size;
+            const char* end = p + body;
+            size_t bytes = 0;
+            for (size_t i = 0; i < count; ++i) {
+                if (size_t(end - p) < entry_header_size || size_t(end - p - entry_header_size) < get16(p + 2)) {
+                    throw wire_error("corrupt scoped wire header");
+                }
+                uint16_t id = get16(p);
+                size_t length = get16(p + 2);
+                for (auto& t : types) {
+                    if (t.id == id) {
+                        m_entries.push_back({&t, p + entry_header_size, length, block::place(bytes, t.node_size, t.node_align)});
+                        break;
+                    }
+                }
+                p += entry_header_size + length;
+            }
+            m_nodes.allocate(bytes);
+            try {
+                for (; m_constructed < m_entries.size(); ++m_constructed) {
+                    const entry& e = m_entries[m_constructed];
+                    if (!e.source->construct(m_nodes.at(e.offset), e.data, e.size)) {
+                        throw wire_error("corrupt scoped wire value");
+                    }
+                }
+            }
+            catch (...) {
+                // Unlink the instances already constructed, e.g. when a decoder throws.
+                clear();
+                throw;
+            }
+        }
+
+        guard(const guard&) = delete;
+        guard& operator=(const guard&) = delete;
+
+        ~guard() {
+            clear();
+        }
+
+        // The number of instances pushed.
+        size_t size() const { return m_constructed; }
+
+    private:
+        struct entry {
+            const type* source;
+            const char* data;
+            size_t size;
+            size_t offset;
+        };
+
+        void clear() {
+            for (; m_constructed > 0; --m_constructed) {
+                const entry& e = m_entries[m_constructed - 1];
+                e.source->destroy(m_nodes.at(e.offset));
+            }
+        }
+
+        using block = detail::node_block<256>;
+
+        block m_nodes;
+        detail::small_vector<entry, 8> m_entries;
+        size_t m_constructed;
+    };
+
+    // Decodes the header at the start of data, and pushes its values for the lifetime of the returned
+    // guard. Sets consumed to the size of the header. Throws a wire_error if the header is malformed.
+    static guard install(const char* data, size_t size, size_t* consumed = nullptr) {
+        return guard(data, size, consumed);
+    }
+
+private:
+    // Types are registered during static initialization, so that encoding and decoding can read the
+    // registry without locking.
+    static std::vector<type>& registry() {
+        static std::vector<type> s_registry;
+        return s_registry;
+    }
+
+    static std::mutex& registry_mutex() {
+        static std::mutex s_mutex;
+        return s_mutex;
+    }
+
+    static void put16(char* p, uint16_t v) {
+        p[0] = char(v & 0xff);
+        p[1] = char(v >> 8);
+    }
+
+    static void put32(char* p, uint32_t v) {
+        put16(p, uint16_t(v & 0xffff));
+        put16(p + 2, uint16_t(v >> 16));
+    }
+
+    static uint16_t get16(const char* p) {
+        return uint16_t(uint8_t(p[0]) | (uint8_t(p[1]) << 8));
+    }
+
+    static uint32_t get32(const char* p) {
+        return uint32_t(get16(p)) | (uint32_t(get16(p + 2)) << 16);
+    }
+};
+
+} // namespace scoped
+
+#endif // _INCLUDE_SCOPED_WIRE_H_
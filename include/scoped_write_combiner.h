@@ -0,0 +1,133 @@
+/*
+scoped_write_combiner.h
+
+Combines increments of shared counters within a scope.
+
+Incrementing a global std::atomic counter from many cores makes its cache line bounce between them. A
+scoped::combined_counter is a global counter whose increments, while a scoped::write_combiner is active
+on the calling thread, are accumulated in a small table inside the innermost combiner instead. The
+combiner applies them with one atomic add per counter when it is destroyed, or when flush() is called.
+Outside of any combiner, and for counters that do not fit in the combiner's table, increments go
+directly to the atomic.
+
+Combined increments are not visible in the counter until they are flushed.
+
+Example:
+
+scoped::combined_counter bytes_read;
+
+void read_block(...) {
+    ...
+    bytes_read.add(n);
+}
+
+void handle_request() {
+    scoped::write_combiner combiner;
+    for (...) {
+        read_block(...);        // Accumulated locally
+    }
+}                               // One atomic add
+*/
+
+#ifndef _INCLUDE_SCOPED_WRITE_COMBINER_H_
+#define _INCLUDE_SCOPED_WRITE_COMBINER_H_
+
+#include "scoped.h"
+#include <atomic>
+#include <cstdint>
+
+namespace scoped
+{
+
+class combined_counter;
+
+class write_combiner : public abstract_scoped<write_combiner> {
+public:
+    // The number of distinct counters a combiner accumulates.
+    static constexpr size_t capacity = 16;
+
+    write_combiner() : m_size(0) {}
+
+    write_combiner(const write_combiner&) = delete;
+    write_combiner& operator=(const write_combiner&) = delete;
+
+    ~write_combiner() {
+        flush();
+    }
+
+    write_combiner& value() override { return *this; }
+
+    // Accumulates delta for counter. Returns false if the table is full and counter is not in it.
+    bool add(combined_counter& counter, int64_t delta) {
+        for (size_t i = 0; i < m_size; ++i) {
+            if (m_entries[i].counter == &counter) {
+                m_entries[i].delta += delta;
+                return true;
+            }
+        }
+        if (m_size == capacity) {
+            return false;
+        }
+        m_entries[m_size++] = {&counter, delta};
+        return true;
+    }
+
+    // Applies the accumulated increments to their counters.
+    inline void flush();
+
+private:
+    struct entry {
+        combined_counter* counter;
+        int64_t delta;
+    };
+
+    entry m_entries[capacity];
+    size_t m_size;
+};
+
+// A global counter whose increments are combined by the innermost write_combiner, if any.
+class combined_counter {
+public:
+    explicit combined_counter(int64_t initial = 0) : m_value(initial) {}
+
+    combined_counter(const combined_counter&) = delete;
+    combined_counter& operator=(const combined_counter&) = delete;
+
+    void add(int64_t delta) {
+        auto combiner = write_combiner::top();
+        if (!combiner || !combiner->value().add(*this, delta)) {
+            m_value.fetch_add(delta, std::memory_order_relaxed);
+        }
+    }
+
+    combined_counter& operator+=(int64_t delta) {
+        add(delta);
+        return *this;
+    }
+
+    combined_counter& operator++() {
+        add(1);
+        return *this;
+    }
+
+    // Returns the value of the counter, not including increments that are not flushed yet.
+    int64_t load() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+    friend class write_combiner;
+
+    alignas(64) std::atomic<int64_t> m_value;
+};
+
+inline void write_combiner::flush() {
+    for (size_t i = 0; i < m_size; ++i) {
+        if (m_entries[i].delta) {
+            m_entries[i].counter->m_value.fetch_add(m_entries[i].delta, std::memory_order_relaxed);
+        }
+    }
+    m_size = 0;
+}
+
+} // namespace scoped
+
+#endif // _INCLUDE_SCOPED_WRITE_COMBINER_H_
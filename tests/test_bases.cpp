@@ -0,0 +1,91 @@
+#include "scoped.h"
+#include <string>
+#include <type_traits>
+#include <vector>
+
+struct ErrorHandler {
+    virtual ~ErrorHandler() = default;
+    virtual std::string handle(const std::string& error) = 0;
+};
+
+struct Logger {
+    virtual ~Logger() = default;
+    virtual void log(const std::string& line) = 0;
+};
+
+struct MetricsSink {
+    virtual ~MetricsSink() = default;
+    virtual void count(const std::string& name) = 0;
+};
+
+struct Service : ErrorHandler, Logger, MetricsSink {
+    explicit Service(std::string name) : name(std::move(name)) {}
+    std::string handle(const std::string& error) override { return name + ": " + error; }
+    void log(const std::string& line) override { lines.push_back(line); }
+    void count(const std::string&) override { ++counts; }
+
+    std::string name;
+    std::vector<std::string> lines;
+    int counts = 0;
+};
+
+struct Console : Logger {
+    void log(const std::string&) override {}
+};
+
+using Services = scoped::polymorphic_scoped<Service, scoped::bases<ErrorHandler, Logger, MetricsSink>>;
+
+static void work() {
+    scoped::abstract_scoped<Logger>::top()->value().log("working");
+    scoped::abstract_scoped<MetricsSink>::top()->value().count("work");
+}
+
+int main() {
+    static_assert(std::is_nothrow_move_constructible<Services>::value == std::is_nothrow_move_constructible<Service>::value, "");
+
+    {
+        Services outer("outer");
+        work();
+        assert(outer.value().lines.size() == 1 && outer.value().counts == 1);
+        assert(scoped::abstract_scoped<ErrorHandler>::top()->value().handle("oops") == "outer: oops");
+        assert(&scoped::abstract_scoped<Logger>::top()->value() == static_cast<Logger*>(&outer.value()));
+        assert(&outer.node<MetricsSink>() == scoped::abstract_scoped<MetricsSink>::top());
+
+        // The chains are independent: an instance for one base does not shadow the others
+        {
+            scoped::polymorphic_scoped<Console, Logger> console;
+            work();
+            assert(outer.value().lines.size() == 1 && outer.value().counts == 2);
+        }
+
+        // Nested instances shadow all the chains, and are removed from all of them
+        {
+            Services inner("inner");
+            work();
+            assert(inner.value().lines.size() == 1 && outer.value().lines.size() == 1);
+            assert(scoped::abstract_scoped<ErrorHandler>::top()->value().handle("x") == "inner: x");
+            assert(scoped::abstract_scoped<Logger>::top()->next() == &outer.node<Logger>());
+        }
+        assert(scoped::abstract_scoped<ErrorHandler>::top() == &outer.node<ErrorHandler>());
+
+        // Defaults at the bottom of all the chains
+        Services defaults(scoped::at_bottom, "defaults");
+        assert(scoped::abstract_scoped<Logger>::bottom() == &defaults.node<Logger>());
+        assert(scoped::abstract_scoped<ErrorHandler>::top()->value().handle("y") == "outer: y");
+    }
+    assert(!scoped::abstract_scoped<ErrorHandler>::top());
+    assert(!scoped::abstract_scoped<Logger>::top());
+    assert(!scoped::abstract_scoped<MetricsSink>::top());
+
+    // Copies are inserted next to the original in every chain
+    {
+        std::vector<Services> services;
+        services.reserve(2);
+        services.emplace_back("a");
+        services.push_back(services[0]);
+        scoped::abstract_scoped<MetricsSink>::top()->value().count("c");
+        assert(services[1].value().counts == 1 && services[0].value().counts == 0);
+    }
+    assert(!scoped::abstract_scoped<Logger>::top());
+    return 0;
+}
@@ -0,0 +1,40 @@
+#include "scoped_breadcrumb.h"
+
+void charge(int amount) {
+    scoped::breadcrumb crumb("charging %d.%02d USD", amount / 100, amount % 100);
+    if (amount > 1000) {
+        throw scoped::breadcrumb_error("payment declined");
+    }
+}
+
+void process(int order_id, const char* shard) {
+    scoped::breadcrumb crumb("processing order %d", order_id);
+    scoped::breadcrumb shard_crumb("in shard %s", shard);
+    assert(scoped::breadcrumb::trail() == std::string("request > processing order ") + std::to_string(order_id) + " > in shard " + shard);
+    charge(order_id * 10);
+}
+
+int main(int argc, char** argv) {
+    assert(scoped::breadcrumb::trail().empty());
+
+    scoped::breadcrumb crumb("request");
+    assert(crumb.str() == "request");
+    process(12, "west");
+    try {
+        process(123, "east");
+        assert(false);
+    }
+    catch (const scoped::breadcrumb_error& e) {
+        assert(e.trail() == "request > processing order 123 > in shard east > charging 12.30 USD");
+        assert(std::string(e.what()) == "payment declined (" + e.trail() + ")");
+    }
+    assert(scoped::breadcrumb::trail() == "request");
+    assert(scoped::breadcrumb::trail("\n") == "request");
+
+    // String literals are stored as pointers
+    {
+        scoped::breadcrumb literal("in shard %s, zone %s", "west", "b");
+        assert(literal.str() == "in shard west, zone b");
+    }
+    return 0;
+}
@@ -0,0 +1,162 @@
+#include "scoped_config.h"
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+using Timeout = scoped::scoped<int, struct TimeoutTag>;
+using Ratio = scoped::scoped<double, struct RatioTag>;
+using Verbose = scoped::scoped<bool, struct VerboseTag>;
+using Region = scoped::scoped<std::string_view, struct RegionTag>;
+using Motd = scoped::scoped<const char*, struct MotdTag>;
+using Missing = scoped::scoped<int, struct MissingTag>;
+using Retries = scoped::scoped<uint8_t, struct RetriesTag>;
+
+// A scoped type whose constructor rejects negative values.
+struct Positive : scoped::abstract_scoped<long, struct PositiveTag> {
+    Positive(scoped::at_bottom_t, long value) : abstract_scoped(scoped::at_bottom), m_value(value) {
+        if (value < 0) throw std::invalid_argument("negative");
+    }
+    long& value() override { return m_value; }
+    long m_value;
+};
+
+static const bool bound = scoped::config_file::bind<Timeout>("net.timeout_ms") &&
+    scoped::config_file::bind<Ratio>("cache.ratio") && scoped::config_file::bind<Verbose>("verbose") &&
+    scoped::config_file::bind<Region>("region") && scoped::config_file::bind<Motd>("motd") &&
+    scoped::config_file::bind<Missing>("missing") && scoped::config_file::bind<Positive>("positive") &&
+    scoped::config_file::bind<Retries>("retries");
+
+static std::string write_file(const std::string& content) {
+    char path[] = "/tmp/scoped_config_test_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    assert(write(fd, content.data(), content.size()) == ssize_t(content.size()));
+    close(fd);
+    return path;
+}
+
+int main(int argc, char** argv) {
+    assert(bound);
+    const char* text =
+        "# service defaults\n"
+        "net.timeout_ms = 100\n"
+        "cache.ratio = 0.75\n"
+        "verbose = true\n"
+        "region = eu-west\n"
+        "motd = \"hello \\\"world\\\"\"\n"
+        "net.timeout_ms = 250\n"
+        "\n";
+    std::string path = write_file(scoped::compile_config(text));
+
+    {
+        scoped::config_file config(path);
+        assert(config.size() == 5);
+        scoped::config_value value;
+        assert(config.find("net.timeout_ms", value) && value.type == scoped::config_type::integer && value.integer == 250);
+        assert(!config.find("net", value));
+
+        Timeout outer(1);
+        {
+            auto defaults = config.install();
+            assert(defaults.size() == 5);
+            // Defaults are at the bottom, below the instances already there
+            assert(Timeout::top()->value() == 1);
+            assert(Timeout::bottom()->value() == 250);
+            assert(Ratio::top()->value() == 0.75);
+            assert(Verbose::top()->value());
+            assert(Region::top()->value() == "eu-west");
+            assert(std::string(Motd::top()->value()) == "hello \"world\"");
+            assert(!Missing::top());
+            // Strings point into the mapping
+            value = scoped::config_value();
+            config.find("region", value);
+            assert(Region::top()->value().data() == value.string.data());
+        }
+        assert(Timeout::bottom() == Timeout::top() && !Region::top());
+    }
+
+    // Type mismatches and malformed files are reported
+    std::string mismatch = write_file(scoped::compile_config("net.timeout_ms = soon\n"));
+    bool thrown = false;
+    try {
+        scoped::config_file config(mismatch);
+        auto defaults = config.install();
+    }
+    catch (const scoped::config_error&) {
+        thrown = true;
+    }
+    assert(thrown && !Timeout::top());
+
+    // Instances installed before a constructor throws are removed
+    std::string negative = write_file(scoped::compile_config("net.timeout_ms = 5\npositive = -1\n"));
+    thrown = false;
+    try {
+        scoped::config_file config(negative);
+        auto defaults = config.install();
+    }
+    catch (const std::invalid_argument&) {
+        thrown = true;
+    }
+    assert(thrown && !Timeout::top() && !Positive::top());
+
+    // Integers are decimal, even with leading zeros
+    {
+        std::string octal = write_file(scoped::compile_config("net.timeout_ms = 010\n"));
+        scoped::config_file config(octal);
+        auto defaults = config.install();
+        assert(Timeout::top()->value() == 10);
+        std::remove(octal.c_str());
+    }
+
+    // Integers that do not fit the bound type are rejected, rather than truncated
+    {
+        std::string fits = write_file(scoped::compile_config("retries = 255\n"));
+        std::string too_large = write_file(scoped::compile_config("retries = 300\n"));
+        std::string negative_retries = write_file(scoped::compile_config("retries = -1\n"));
+        {
+            scoped::config_file config(fits);
+            auto defaults = config.install();
+            assert(Retries::top()->value() == 255);
+        }
+        for (auto& path : {too_large, negative_retries}) {
+            bool rejected = false;
+            try {
+                scoped::config_file config(path);
+                auto defaults = config.install();
+            }
+            catch (const scoped::config_error& e) {
+                rejected = std::string(e.what()).find("retries") != std::string::npos;
+            }
+            assert(rejected && !Retries::top());
+        }
+        std::remove(fits.c_str());
+        std::remove(too_large.c_str());
+        std::remove(negative_retries.c_str());
+    }
+
+    thrown = false;
+    try {
+        scoped::compile_config("a = 1\nno equals sign\n");
+    }
+    catch (const scoped::config_error& e) {
+        thrown = std::string(e.what()).find("line 2") != std::string::npos;
+    }
+    assert(thrown);
+
+    std::string garbage = write_file("not a config file at all");
+    thrown = false;
+    try {
+        scoped::config_file config(garbage);
+    }
+    catch (const scoped::config_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    std::remove(path.c_str());
+    std::remove(mismatch.c_str());
+    std::remove(garbage.c_str());
+    std::remove(negative.c_str());
+    return 0;
+}
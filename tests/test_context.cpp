@@ -0,0 +1,98 @@
+#include "scoped_context.h"
+#include <array>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+using ScopedTenant = scoped::scoped<std::string, struct TenantTag>;
+using ScopedLimit = scoped::scoped<int, struct LimitTag>;
+using ScopedLocal = scoped::scoped<int, struct LocalTag>;
+
+// Too large for the inline storage of detached_context
+using ScopedBlob = scoped::scoped<std::array<char, scoped::detached_context::inline_size>>;
+
+static const bool tenant_propagated = scoped::context::propagate<ScopedTenant>();
+static const bool limit_propagated = scoped::context::propagate<ScopedLimit::abstract>() &&
+    scoped::context::propagate<ScopedLimit>();
+static const bool blob_propagated = scoped::context::propagate<ScopedBlob>();
+
+// Registers one chain per index, and returns false once the registry is full.
+template<size_t... Is> static bool propagate_fillers(std::index_sequence<Is...>) {
+    try {
+        (scoped::context::propagate<scoped::scoped<int, std::integral_constant<size_t, Is>>>(), ...);
+    }
+    catch (const std::length_error&) {
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    assert(tenant_propagated && limit_propagated && blob_propagated);
+    assert(scoped::context::capture().empty());
+
+    ScopedTenant tenant("acme");
+    ScopedLimit limit(10);
+    ScopedLocal local(1);
+    auto ctx = scoped::context::capture();
+    assert(!ctx.empty());
+
+    std::thread worker([&ctx] {
+        assert(!ScopedTenant::top() && !ScopedLimit::top());
+        ScopedLimit outer_limit(5);
+        {
+            auto guard = ctx.install();
+            assert(ScopedTenant::top()->value() == "acme");
+            assert(ScopedLimit::top()->value() == 10);
+            assert(ScopedLimit::top()->next()->value() == 5);
+            // The chain was registered twice, but is captured once
+            assert(ScopedLimit::top()->next() == &outer_limit);
+            assert(!ScopedLocal::top());
+
+            // Values are shared with the capturing thread, not copied
+            ScopedTenant::top()->value() += "-corp";
+        }
+        assert(!ScopedTenant::top());
+        assert(ScopedLimit::top()->value() == 5);
+    });
+    worker.join();
+    assert(tenant.value() == "acme-corp");
+
+    // Installing on the capturing thread pushes nothing
+    {
+        auto guard = ctx.install();
+        assert(ScopedTenant::top() == &tenant);
+        assert(!tenant.next());
+    }
+    int result = ctx.run([] { return ScopedLimit::top()->value() * 2; });
+    assert(result == 20);
+
+    // Moving a detached context takes its copies, whether they are stored inline or not
+    for (bool large : {false, true}) {
+        scoped::detached_context from;
+        {
+            ScopedTenant inner(std::string(40, 'x'));
+            ScopedBlob blob(std::array<char, scoped::detached_context::inline_size>{'b'});
+            if (large) {
+                from = scoped::detached_context::capture();
+            }
+            else {
+                ScopedBlob::shield shield;
+                from = scoped::detached_context::capture();
+            }
+        }
+        scoped::detached_context to(std::move(from));
+        assert(from.empty() && !to.empty());
+        std::thread([&to, large] {
+            auto guard = to.install();
+            assert(ScopedTenant::top()->value() == std::string(40, 'x'));
+            assert(large ? ScopedBlob::top() && ScopedBlob::top()->value()[0] == 'b' : !ScopedBlob::top());
+        }).join();
+    }
+
+    // Registering more chains than the registry holds fails
+    assert(!propagate_fillers(std::make_index_sequence<64>()));
+    return 0;
+}
@@ -0,0 +1,44 @@
+#include "scoped_cost_center.h"
+#include <thread>
+
+static void burn(uint64_t ns) {
+    uint64_t start = scoped::cost_center::thread_cpu_ns();
+    while (scoped::cost_center::thread_cpu_ns() - start < ns);
+}
+
+int main(int argc, char** argv) {
+    scoped::cost_account acme("acme");
+    scoped::cost_account globex("globex");
+    const uint64_t ms = 1000000;
+
+    {
+        scoped::cost_center billing(acme);
+        burn(5 * ms);
+        {
+            scoped::cost_center nested(globex);
+            burn(5 * ms);
+        }
+        burn(5 * ms);
+
+        auto ctx = scoped::context::capture();
+        std::thread worker([&ctx] {
+            burn(20 * ms);   // Not charged: no cost center yet
+            auto guard = ctx.install();
+            burn(5 * ms);
+        });
+        worker.join();
+    }
+
+    assert(globex.name() == "globex");
+    assert(globex.cpu_ns() >= 5 * ms && globex.cpu_ns() < 7 * ms);
+    assert(acme.cpu_ns() >= 15 * ms && acme.cpu_ns() < 20 * ms);
+
+    {
+        scoped::cost_center billing(globex);
+        burn(2 * ms);
+        uint64_t before = globex.cpu_ns();
+        scoped::cost_center::sample();
+        assert(globex.cpu_ns() >= before + 2 * ms);
+    }
+    return 0;
+}
@@ -0,0 +1,57 @@
+#include "scoped_defer.h"
+#include <string>
+
+static std::string log;
+
+void update(const std::string& key) {
+    log += "update " + key + ";";
+    scoped::defer_queue::defer([] { log += "flush;"; }, 1);
+    scoped::defer_queue::defer([key] { log += "release " + key + ";"; });
+}
+
+int main(int argc, char** argv) {
+    // Without a queue, actions run immediately
+    assert(!scoped::defer_queue::defer([] { log += "now;"; }));
+    assert(log == "now;");
+
+    log.clear();
+    {
+        scoped::defer_queue deferred;
+        update("a");
+        update("b");
+        scoped::defer_queue::defer([] { log += "first;"; }, scoped::defer_queue::no_key, -1);
+        assert(deferred.pending() == 5);
+        assert(log == "update a;update b;");
+    }
+    assert(log == "update a;update b;first;release a;flush;release b;");
+
+    // Nested queues run their own batch, unless they bubble up
+    log.clear();
+    {
+        scoped::defer_queue outer;
+        {
+            scoped::defer_queue inner;
+            update("a");
+        }
+        assert(log == "update a;flush;release a;");
+        {
+            scoped::defer_queue inner(true);
+            update("b");
+        }
+        update("c");
+        assert(log == "update a;flush;release a;update b;update c;");
+    }
+    assert(log == "update a;flush;release a;update b;update c;release b;flush;release c;");
+
+    // Actions deferred while the batch runs are run in a new batch
+    log.clear();
+    {
+        scoped::defer_queue deferred;
+        scoped::defer_queue::defer([] {
+            log += "outer;";
+            scoped::defer_queue::defer([] { log += "inner;"; });
+        });
+    }
+    assert(log == "outer;inner;");
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include "scoped_context.h"
+#include <string>
+#include <thread>
+#include <vector>
+
+struct TextDecorator {
+    virtual ~TextDecorator() = default;
+    virtual std::string decorate(const std::string& text) = 0;
+};
+
+struct Bold : TextDecorator {
+    std::string decorate(const std::string& text) override { return "*" + text + "*"; }
+};
+
+struct Prefix : TextDecorator {
+    Prefix(std::string prefix) : prefix(std::move(prefix)) {}
+    std::string decorate(const std::string& text) override { return prefix + text; }
+    std::string prefix;
+};
+
+// Derives from Prefix, but is a different type for find_first()
+struct Label : Prefix {
+    using Prefix::Prefix;
+};
+
+using Decorators = scoped::abstract_scoped<TextDecorator>;
+static const bool decorators_propagated = scoped::context::propagate<Decorators>();
+
+int main(int argc, char** argv) {
+    assert(decorators_propagated);
+    assert(scoped::type_id<Bold>() != scoped::type_id<Prefix>());
+    assert(!Decorators::find_first<Bold>());
+
+    {
+        scoped::polymorphic_scoped<Prefix, TextDecorator> a("a:");
+        scoped::polymorphic_scoped<Bold, TextDecorator> bold;
+        scoped::polymorphic_scoped<Label, TextDecorator> label("label:");
+        scoped::polymorphic_scoped<Prefix, TextDecorator> b("b:");
+
+        assert(Decorators::top()->type() == scoped::type_id<Prefix>());
+        assert(Decorators::find_first<Prefix>() == &b.value());
+        assert(Decorators::find_first<Bold>() == &bold.value());
+        assert(Decorators::find_first<Label>()->prefix == "label:");
+
+        std::vector<std::string> prefixes;
+        Decorators::for_each_of<Prefix>([&](Prefix& p) { prefixes.push_back(p.prefix); });
+        assert((prefixes == std::vector<std::string>{"b:", "a:"}));
+
+        // Copies and moves keep the type
+        {
+            const auto& original = bold;
+            auto copy = original;
+            assert(Decorators::find_first<Bold>() == &copy.value());
+        }
+        {
+            std::vector<scoped::polymorphic_scoped<Bold, TextDecorator>> bolds(2);
+            bolds.emplace_back();
+            int count = 0;
+            Decorators::for_each_of<Bold>([&](Bold&) { ++count; });
+            assert(count == 4);
+        }
+    }
+    assert(!Decorators::find_first<Prefix>());
+
+    // Values received through a context keep their types
+    {
+        scoped::polymorphic_scoped<Bold, TextDecorator> bold;
+        auto ctx = scoped::context::capture();
+        std::thread([&ctx, &bold] {
+            assert(!Decorators::find_first<Bold>());
+            auto guard = ctx.install();
+            assert(Decorators::find_first<Bold>() == &bold.value());
+            int count = 0;
+            Decorators::for_each_of<Bold>([&](Bold&) { ++count; });
+            assert(count == 1);
+        }).join();
+    }
+
+    // Scoped values of one type, and values scoped in several chains
+    {
+        scoped::scoped<int> i(1);
+        assert(*scoped::scoped<int>::abstract::find_first<int>() == 1);
+
+        struct Multi : TextDecorator {
+            std::string decorate(const std::string& text) override { return text; }
+        };
+        scoped::polymorphic_scoped<Multi, scoped::bases<TextDecorator>> multi;
+        assert(Decorators::find_first<Multi>() == &multi.value());
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include "scoped_fingerprint.h"
+#include <string>
+
+using ScopedTenant = scoped::fingerprinted<std::string, struct TenantTag>;
+using ScopedShard = scoped::fingerprinted<int, struct ShardTag>;
+using PlainShard = scoped::scoped<int, struct ShardTag>;
+
+uint64_t current() {
+    return scoped::fingerprint<ScopedTenant, ScopedShard>();
+}
+
+const std::string& path() {
+    return scoped::scope_path<ScopedTenant, ScopedShard>();
+}
+
+int main(int argc, char** argv) {
+    const uint64_t empty = current();
+    assert(path().empty());
+
+    uint64_t acme_7;
+    {
+        ScopedTenant tenant("acme");
+        uint64_t acme = current();
+        assert(acme != empty);
+        {
+            ScopedShard shard(7);
+            acme_7 = current();
+            assert(acme_7 != acme);
+            assert(path() == "/acme/7");
+            {
+                ScopedShard::shield shield;
+                assert(current() == acme);
+            }
+            assert(current() == acme_7);
+        }
+        assert(current() == acme);
+        {
+            // Plain scoped values hash the same, by walking the chain
+            PlainShard shard(7);
+            assert(current() == acme_7);
+            ScopedShard nested(8);
+            assert(current() != acme_7);
+            assert(path() == "/acme/7/8");
+        }
+        {
+            ScopedShard shard(8);
+            assert(current() != acme_7);
+        }
+    }
+    assert(current() == empty);
+    {
+        ScopedShard shard(7);
+        ScopedTenant tenant("acme");
+        assert(current() == acme_7);
+    }
+    {
+        ScopedTenant tenant("globex");
+        ScopedShard shard(7);
+        assert(current() != acme_7);
+        assert(path() == "/globex/7");
+    }
+    assert(path().empty());
+    return 0;
+}
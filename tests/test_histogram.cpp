@@ -0,0 +1,65 @@
+#include "scoped_histogram.h"
+#include <thread>
+
+void query(uint64_t latency) {
+    scoped::histogram::record_in_scope(latency);
+}
+
+int main(int argc, char** argv) {
+    using data = scoped::histogram_data;
+
+    // Buckets cover every value, with the advertised precision
+    for (uint64_t v : {0ull, 1ull, 63ull, 64ull, 65ull, 1000ull, 123456789ull, ~0ull}) {
+        size_t b = data::bucket_of(v);
+        assert(b < data::num_buckets);
+        assert(data::lowest_of(b) <= v && v <= data::highest_of(b));
+        assert(v - data::lowest_of(b) <= v / data::half_bucket_count);
+    }
+    for (size_t b = 1; b < data::num_buckets; ++b) {
+        assert(data::lowest_of(b) == data::highest_of(b - 1) + 1);
+        assert(data::bucket_of(data::lowest_of(b)) == b);
+    }
+
+    query(5);   // No histogram in scope
+    {
+        scoped::histogram latencies("query_ns");
+        for (uint64_t v = 1; v <= 1000; ++v) {
+            query(v);
+        }
+        assert(latencies.data().count() == 1000);
+        assert(latencies.percentile(50.0) >= 490 && latencies.percentile(50.0) <= 510);
+        assert(latencies.percentile(99.0) >= 980 && latencies.percentile(99.0) <= 1000);
+        assert(latencies.percentile(100.0) == 1000);
+        assert(latencies.data().min() == 1 && latencies.data().max() == 1000);
+
+        {
+            scoped::histogram nested;
+            query(2000);
+            assert(nested.data().count() == 1);
+        }
+        assert(latencies.data().count() == 1001);
+
+        auto ctx = scoped::context::capture();
+        std::thread worker([&ctx] {
+            auto guard = ctx.install();
+            scoped::histogram local;
+            for (int i = 0; i < 100; ++i) {
+                query(3000);
+            }
+        });
+        worker.join();
+        assert(latencies.data().count() == 1101);
+        std::thread([&ctx] {
+            auto guard = ctx.install();
+            query(3000);
+        }).join();
+        assert(latencies.data().count() == 1102);
+        assert(latencies.data().max() == 3000);
+    }
+
+    auto global = scoped::histogram_registry::instance().snapshot("query_ns");
+    assert(global.count() == 1102);
+    assert(global.percentile(95.0) == 3000 || global.percentile(95.0) >= 2950);
+    assert(scoped::histogram_registry::instance().names().size() == 1);
+    return 0;
+}
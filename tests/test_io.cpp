@@ -0,0 +1,104 @@
+#include "scoped_io.h"
+#include <cstdlib>
+#include <fcntl.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+static void check_backend(int fd, scoped::io_backend backend) {
+    const size_t block = 4096, blocks = 64;
+    std::vector<std::vector<char>> buffers(blocks, std::vector<char>(block));
+    std::vector<scoped::io_future> reads;
+    {
+        scoped::io_batch batch(8, backend);
+        for (size_t i = 0; i < blocks; ++i) {
+            size_t b = (i * 37) % blocks;
+            reads.push_back(scoped::read(fd, buffers[i].data(), block, off_t(b * block)));
+        }
+        // Waiting inside the batch submits what is queued
+        assert(reads[blocks - 1].get() == ssize_t(block));
+        assert(buffers[blocks - 1][0] == char('a' + ((blocks - 1) * 37 % blocks) % 26));
+    }
+    for (size_t i = 0; i < blocks; ++i) {
+        assert(reads[i].ready());
+        assert(reads[i].get() == ssize_t(block));
+        assert(buffers[i][block - 1] == char('a' + ((i * 37) % blocks) % 26));
+    }
+
+    // Errors are negated errno values
+    char c;
+    scoped::io_future bad;
+    {
+        scoped::io_batch batch(8, backend);
+        bad = scoped::read(-1, &c, 1, 0);
+    }
+    assert(bad.get() == -EBADF);
+}
+
+// Requests that fail to be submitted are taken back out of the ring, and are not submitted later
+static void check_submit_error(int fd) {
+    scoped::detail::uring ring;
+    if (!ring.ok()) return;
+    char failed[16] = {}, submitted[16] = {};
+    auto op = [fd](char* buffer) {
+        auto o = std::make_shared<scoped::detail::io_op>();
+        o->is_write = false;
+        o->fd = fd;
+        o->buffer = buffer;
+        o->size = 16;
+        o->offset = 0;
+        o->batch = nullptr;
+        return o;
+    };
+    auto first = op(failed);
+    assert(ring.queue(first.get()));
+    ring.cancel_unsubmitted(-EAGAIN);
+    assert(first->done && first->result == -EAGAIN && ring.unsubmitted() == 0);
+
+    auto second = op(submitted);
+    assert(ring.queue(second.get()));
+    first.reset();
+    assert(ring.enter(1) == 1);
+    assert(second->done && second->result == 16 && submitted[0] == 'a');
+    assert(failed[0] == 0);
+}
+
+int main(int argc, char** argv) {
+    char path[] = "/tmp/scoped_io_test_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    unlink(path);
+
+    // Outside of a batch, I/O is synchronous
+    const size_t block = 4096, blocks = 64;
+    for (size_t b = 0; b < blocks; ++b) {
+        std::string data(block, char('a' + b % 26));
+        auto f = scoped::write(fd, data.data(), data.size(), off_t(b * block));
+        assert(f.ready() && f.get() == ssize_t(block));
+    }
+
+    // Writes in a batch complete at scope exit
+    {
+        std::string data(block, 'z');
+        scoped::io_future f;
+        {
+            scoped::io_batch batch;
+            f = scoped::write(fd, data.data(), data.size(), off_t(blocks * block));
+        }
+        assert(f.ready() && f.get() == ssize_t(block));
+    }
+
+    {
+        scoped::io_batch batch;
+        if (batch.backend() == scoped::io_backend::uring) {
+            check_backend(fd, scoped::io_backend::uring);
+        }
+    }
+    check_backend(fd, scoped::io_backend::thread_pool);
+    check_backend(fd, scoped::io_backend::automatic);
+
+    check_submit_error(fd);
+
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,117 @@
+#include "scoped_lazy.h"
+#include "scoped_context.h"
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+static int constructed = 0;
+static int destroyed = 0;
+
+struct Ruleset {
+    explicit Ruleset(std::string name) : name(std::move(name)) { ++constructed; }
+    Ruleset(const Ruleset&) = delete;
+    ~Ruleset() { ++destroyed; }
+    std::string name;
+};
+
+using Rules = scoped::abstract_scoped<Ruleset>;
+
+using Region = scoped::abstract_scoped<std::string, struct RegionTag>;
+static const bool region_propagated = scoped::context::propagate<Region>();
+
+int main(int argc, char** argv) {
+    // Never read: neither built nor destroyed, and the factory is released
+    {
+        auto captured = std::make_shared<int>(1);
+        {
+            scoped::lazy<Ruleset> rules([captured] { return Ruleset("unused"); });
+            assert(Rules::top() == &rules && !rules.is_built());
+            assert(captured.use_count() == 2);
+        }
+        assert(captured.use_count() == 1);
+        assert(constructed == 0 && destroyed == 0);
+    }
+
+    // Built once, on the first read through the chain
+    {
+        int calls = 0;
+        scoped::lazy<Ruleset> rules([&] { ++calls; return Ruleset("rules"); });
+        assert(Rules::top()->value().name == "rules");
+        assert(Rules::top()->value().name == "rules");
+        assert(calls == 1 && constructed == 1 && rules.is_built());
+        assert(Rules::find_first<Ruleset>() == &rules.value());
+    }
+    assert(destroyed == 1);
+
+    // Ordering and shielding are those of the chain, whether or not the value was built
+    {
+        scoped::polymorphic_scoped<Ruleset, Ruleset> outer("outer");
+        {
+            scoped::lazy<Ruleset> inner([] { return Ruleset("inner"); });
+            assert(Rules::top() == &inner && inner.next() == &outer);
+            {
+                Rules::shield shield;
+                assert(!Rules::top());
+            }
+            assert(!inner.is_built());
+        }
+        scoped::lazy<Ruleset> defaults(scoped::at_bottom, [] { return Ruleset("defaults"); });
+        assert(Rules::top()->value().name == "outer" && Rules::bottom() == &defaults);
+    }
+    assert(!Rules::top());
+
+    // A throwing factory is retried on the next read
+    {
+        int attempts = 0;
+        scoped::lazy<Ruleset> rules([&] {
+            if (++attempts == 1) throw std::runtime_error("unavailable");
+            return Ruleset("retried");
+        });
+        bool thrown = false;
+        try {
+            rules.value();
+        }
+        catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        assert(thrown && !rules.is_built());
+        assert(rules.value().name == "retried" && attempts == 2);
+    }
+
+    // Concurrent first reads build the value once
+    {
+        int calls = 0;
+        scoped::lazy<Ruleset> rules([&] { ++calls; return Ruleset("shared"); });
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 4; ++i) {
+            threads.emplace_back([&] { assert(rules.value().name == "shared"); });
+        }
+        for (auto& t : threads) t.join();
+        assert(calls == 1);
+    }
+
+    // Capturing a context does not build the value: the first task that reads it does
+    {
+        assert(region_propagated);
+        scoped::lazy<std::string, struct RegionTag> region([] { return std::string("eu-west"); });
+        auto ctx = scoped::context::capture();
+        assert(!region.is_built());
+        std::thread([&ctx] { auto guard = ctx.install(); }).join();
+        assert(!region.is_built());
+        std::thread([&ctx] {
+            auto guard = ctx.install();
+            assert(Region::top()->value() == "eu-west");
+        }).join();
+        assert(region.is_built());
+    }
+
+    // A detached context copies the value, which builds it
+    {
+        scoped::lazy<std::string, struct RegionTag> region([] { return std::string("us-east"); });
+        auto detached = scoped::detached_context::capture();
+        assert(region.is_built());
+    }
+    return 0;
+}
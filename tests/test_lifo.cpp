@@ -0,0 +1,52 @@
+#include "scoped_lifo.h"
+#include <string>
+#include <type_traits>
+
+using Depth = scoped::lifo<int, struct DepthTag>;
+using Name = scoped::lifo<std::string, struct NameTag>;
+
+static int deepest = 0;
+
+static void recurse(int levels) {
+    Depth depth(Depth::top() ? Depth::top()->value() + 1 : 0);
+    if (levels) {
+        recurse(levels - 1);
+    }
+    else {
+        deepest = Depth::top()->value();
+        int count = 0;
+        for (auto p = Depth::top(); p; p = p->next()) {
+            ++count;
+        }
+        assert(count == deepest + 1);
+    }
+}
+
+int main(int argc, char** argv) {
+    static_assert(sizeof(scoped::lifo<int>) == 2 * sizeof(void*), "one link besides the padded value");
+    static_assert(sizeof(scoped::lifo<void*>) == sizeof(void*) + sizeof(scoped::lifo<void*>::value_type), "");
+    static_assert(!std::is_polymorphic<scoped::lifo<int>>::value, "");
+    static_assert(!std::is_copy_constructible<scoped::lifo<int>>::value, "");
+
+    assert(!Depth::top());
+    recurse(1000);
+    assert(deepest == 1000);
+    assert(!Depth::top());
+
+    {
+        Name outer("outer");
+        assert(Name::top()->value() == "outer");
+        {
+            Name inner("xxx");
+            assert(Name::top()->value() == "xxx");
+            assert(Name::top()->next() == &outer);
+            inner.value() += "y";
+            assert(Name::top()->value() == "xxxy");
+        }
+        assert(Name::top() == &outer && !outer.next());
+        // Chains are separate per type and tags
+        assert(!Depth::top());
+    }
+    assert(!Name::top());
+    return 0;
+}
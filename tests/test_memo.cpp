@@ -0,0 +1,92 @@
+#include "scoped_memo.h"
+#include <string>
+#include <thread>
+
+using ScopedThreshold = scoped::fingerprinted<int, struct ThresholdTag>;
+
+static int calls = 0;
+
+int classify_impl(int x) {
+    ++calls;
+    auto thresh = ScopedThreshold::top();
+    return (thresh && x >= thresh->value()) ? -1 : x;
+}
+
+std::string greet_impl(const std::string& name, int times) {
+    std::string result;
+    for (int i = 0; i < times; ++i) {
+        result += "hello " + name + " ";
+    }
+    return result;
+}
+
+// A result that counts its live copies
+static int live = 0;
+
+struct counted {
+    counted() { ++live; }
+    counted(const counted&) { ++live; }
+    counted& operator=(const counted&) = default;
+    ~counted() { --live; }
+};
+
+counted make_counted(int) {
+    return counted();
+}
+
+int main(int argc, char** argv) {
+    scoped::memo<int(int), ScopedThreshold> classify(classify_impl);
+
+    assert(classify(10) == 10);
+    assert(classify(10) == 10);
+    assert(calls == 1);
+    {
+        ScopedThreshold thresh(4);
+        assert(classify(10) == -1);
+        assert(classify(3) == 3);
+        assert(classify(10) == -1);
+        assert(calls == 3);
+        {
+            ScopedThreshold nested(20);
+            assert(classify(10) == 10);
+            assert(calls == 4);
+        }
+        assert(classify(10) == -1);
+        assert(calls == 4);
+    }
+    assert(classify(10) == 10);
+    assert(calls == 4);
+
+    // Per-thread tables are not shared
+    std::thread([&classify] { assert(classify(10) == 10); }).join();
+    assert(calls == 5);
+
+    // A bounded table evicts older results
+    scoped::memo<int(int), ScopedThreshold> small(classify_impl, 2);
+    calls = 0;
+    for (int i = 0; i < 100; ++i) {
+        small(i);
+    }
+    assert(calls == 100);
+    for (int i = 0; i < 100; ++i) {
+        small(i);
+    }
+    assert(calls > 100);
+
+    scoped::memo<std::string(const std::string&, int)> greet(greet_impl, 64, scoped::memo_mode::sharded);
+    std::thread worker([&greet] { assert(greet("bob", 2) == "hello bob hello bob "); });
+    worker.join();
+    assert(greet("bob", 2) == "hello bob hello bob ");
+    assert(greet("bob", 1) == "hello bob ");
+
+    // Per-thread tables are freed when their thread exits, and when the memo is destroyed
+    {
+        scoped::memo<counted(int)> cache(make_counted, 8);
+        cache(1);
+        assert(live == 8);
+        std::thread([&cache] { cache(1); }).join();
+        assert(live == 8);
+    }
+    assert(live == 0);
+    return 0;
+}
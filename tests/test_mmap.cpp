@@ -0,0 +1,57 @@
+#include "scoped_mmap.h"
+#include <cstdio>
+#include <string>
+
+static std::string make_file(const std::string& content) {
+    char path[] = "/tmp/scoped_mmap_test_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    assert(write(fd, content.data(), content.size()) == ssize_t(content.size()));
+    close(fd);
+    return path;
+}
+
+int main(int argc, char** argv) {
+    std::string a = make_file("alpha"), b = make_file("bravo bravo"), empty = make_file("");
+
+    // Without a cache, the view owns its mapping
+    {
+        scoped::mmap_view view = scoped::map_file(a);
+        scoped::mmap_view copy = view;
+        view = scoped::mmap_view();
+        assert(copy.str() == "alpha");
+    }
+
+    // Views are reused within the scope, including by nested caches
+    {
+        scoped::mmap_cache outer(scoped::mmap_cache::will_need);
+        auto first = scoped::map_file(a);
+        assert(first.str() == "alpha");
+        assert(scoped::map_file(a).data() == first.data());
+        {
+            scoped::mmap_cache inner(scoped::mmap_cache::sequential);
+            assert(scoped::map_file(a).data() == first.data());
+            auto other = scoped::map_file(b);
+            assert(std::string(other.begin(), other.end()) == "bravo bravo");
+            assert(inner.size() == 1);
+        }
+        assert(outer.size() == 1);
+        assert(scoped::map_file(empty).empty());
+        assert(outer.size() == 2);
+    }
+
+    // Errors are reported as exceptions
+    bool thrown = false;
+    try {
+        scoped::map_file("/nonexistent/file");
+    }
+    catch (const std::system_error& e) {
+        thrown = e.code() == std::errc::no_such_file_or_directory;
+    }
+    assert(thrown);
+
+    std::remove(a.c_str());
+    std::remove(b.c_str());
+    std::remove(empty.c_str());
+    return 0;
+}
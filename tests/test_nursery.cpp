@@ -0,0 +1,126 @@
+#include "scoped_nursery.h"
+#include <atomic>
+#include <stdexcept>
+#include <string>
+
+using Name = scoped::scoped<std::string>;
+static const bool name_propagated = scoped::context::propagate<Name>();
+
+// Spawns tasks into the innermost nursery, recursively
+void tree(std::atomic<int>& count, int depth) {
+    ++count;
+    if (depth == 0) return;
+    for (int i = 0; i < 2; ++i) {
+        scoped::nursery::top()->spawn([&count, depth] { tree(count, depth - 1); });
+    }
+}
+
+// Spawns a task that reads a scoped value of the callee, which returns before the task runs
+void spawn_with_own_name(std::atomic<int>& wrong_scope) {
+    Name name("callee, with a name longer than the small string buffer");
+    scoped::nursery::top()->spawn([&wrong_scope] {
+        if (!Name::top() || Name::top()->value() != "callee, with a name longer than the small string buffer") {
+            ++wrong_scope;
+        }
+    });
+}
+
+int main(int argc, char** argv) {
+    assert(name_propagated);
+    assert(!scoped::nursery::top());
+
+    // Tasks hold copies of values pushed by a callee after the nursery, which exits before the join
+    {
+        std::atomic<int> wrong_scope(0);
+        scoped::nursery tasks;
+        for (int i = 0; i < 100; ++i) {
+            spawn_with_own_name(wrong_scope);
+        }
+        assert(!Name::top());
+        tasks.join();
+        assert(wrong_scope == 0);
+    }
+
+    // Tasks see the spawner's scoped values, and spawn into the same nursery; all are joined
+    {
+        std::atomic<int> count(0);
+        std::atomic<int> wrong_scope(0);
+        {
+            scoped::nursery tasks;
+            assert(scoped::nursery::top() == &tasks);
+            Name name("request");
+            for (int i = 0; i < 1000; ++i) {
+                tasks.spawn([&] {
+                    if (!Name::top() || Name::top()->value() != "request" || scoped::nursery::top() != &tasks) {
+                        ++wrong_scope;
+                    }
+                });
+            }
+            tree(count, 10);
+        }
+        assert(count == (1 << 11) - 1);
+        assert(wrong_scope == 0);
+    }
+
+    // Nested nurseries in tasks are joined by helping, even with few pool threads
+    {
+        std::atomic<int> count(0);
+        scoped::nursery outer;
+        for (int i = 0; i < 8; ++i) {
+            outer.spawn([&count] {
+                scoped::nursery inner;
+                for (int j = 0; j < 8; ++j) {
+                    inner.spawn([&count] { ++count; });
+                }
+                inner.join();
+            });
+        }
+        outer.join();
+        assert(count == 64);
+    }
+
+    // Exceptions are aggregated by join
+    {
+        scoped::nursery tasks;
+        for (int i = 0; i < 10; ++i) {
+            tasks.spawn([i] {
+                if (i % 3 == 0) throw std::runtime_error("task failed");
+            });
+        }
+        bool caught = false;
+        try {
+            tasks.join();
+        }
+        catch (const scoped::nursery_error& e) {
+            caught = e.errors().size() == 4 && std::string(e.what()).find("task failed") != std::string::npos;
+        }
+        assert(caught);
+        tasks.join();
+    }
+
+    // ... and thrown by the destructor, when it is not unwinding
+    {
+        bool caught = false;
+        try {
+            scoped::nursery tasks;
+            tasks.spawn([] { throw std::logic_error("oops"); });
+        }
+        catch (const scoped::nursery_error& e) {
+            caught = e.errors().size() == 1;
+        }
+        assert(caught);
+
+        caught = false;
+        try {
+            scoped::nursery tasks;
+            tasks.spawn([] { throw std::logic_error("oops"); });
+            throw std::runtime_error("caller failed");
+        }
+        catch (const std::runtime_error& e) {
+            caught = std::string(e.what()) == "caller failed";
+        }
+        assert(caught);
+    }
+
+    return 0;
+}
@@ -0,0 +1,52 @@
+#include "scoped_omp.h"
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using ScopedThreshold = scoped::scoped<int, struct ThresholdTag>;
+static const bool threshold_propagated = scoped::context::propagate<ScopedThreshold>();
+
+int main(int argc, char** argv) {
+    std::vector<int> values(1000);
+    for (size_t i = 0; i < values.size(); ++i) {
+        values[i] = int(i);
+    }
+
+    ScopedThreshold threshold(100);
+    std::atomic<int> missing(0), duplicated(0);
+    SCOPED_OMP_PARALLEL(num_threads(4)) {
+        // Every thread sees the caller's value exactly once in its chain
+        auto top = ScopedThreshold::top();
+        if (!top) {
+            ++missing;
+        }
+        else if (top->next()) {
+            ++duplicated;
+        }
+        #pragma omp for
+        for (int i = 0; i < int(values.size()); ++i) {
+            values[i] = std::min(values[i], ScopedThreshold::top()->value());
+        }
+    }
+    assert(missing == 0 && duplicated == 0);
+    for (size_t i = 0; i < values.size(); ++i) {
+        assert(values[i] == std::min(int(i), 100));
+    }
+
+#ifdef _OPENMP
+    // Worker threads are left without the values after the region
+    std::atomic<int> leaked(0);
+    #pragma omp parallel num_threads(4)
+    {
+        if (omp_get_thread_num() != 0 && ScopedThreshold::top()) {
+            ++leaked;
+        }
+    }
+    assert(leaked == 0);
+#endif
+    return 0;
+}
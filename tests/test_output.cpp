@@ -0,0 +1,71 @@
+#include "scoped_output.h"
+#include <fcntl.h>
+#include <string>
+
+// Returns what is available in the pipe, without blocking.
+static std::string available(int fd) {
+    std::string result;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+        result.append(buffer, size_t(n));
+    }
+    return result;
+}
+
+int main(int argc, char** argv) {
+    int pipe_fds[2];
+    assert(pipe2(pipe_fds, O_NONBLOCK) == 0);
+    int in = pipe_fds[0], out = pipe_fds[1];
+
+    // Without a buffer, output is written directly
+    assert(scoped::output("direct\n", out));
+    assert(available(in) == "direct\n");
+
+    // Nested buffers hand their output over to the enclosing buffer, which writes it at exit
+    {
+        scoped::output_buffer request(out);
+        scoped::output("a", out);
+        {
+            scoped::output_buffer nested(out);
+            scoped::output_buffer other_fd(STDERR_FILENO);
+            scoped::output("b", out);
+            assert(nested.size() == 1 && other_fd.size() == 0);
+        }
+        assert(request.size() == 2);
+        scoped::output("c", out);
+        assert(available(in) == "");
+    }
+    assert(available(in) == "abc");
+
+    // A full buffer is flushed
+    {
+        scoped::output_buffer buffer(out, 100);
+        std::string line(30, 'x');
+        for (int i = 0; i < 3; ++i) {
+            scoped::output(line, out);
+        }
+        assert(available(in) == "");
+        scoped::output(line, out);
+        assert(buffer.size() == 0);
+        assert(available(in) == std::string(120, 'x'));
+    }
+
+    // Long outputs span several chunks, and partial writes are resumed
+    {
+        std::string expected;
+        {
+            scoped::output_buffer buffer(out);
+            for (int i = 0; i < 100; ++i) {
+                std::string text(i * 10, char('a' + i % 26));
+                scoped::output(text, out);
+                expected += text;
+            }
+        }
+        assert(available(in) == expected);
+    }
+
+    close(in);
+    close(out);
+    return 0;
+}
@@ -0,0 +1,156 @@
+#include "scoped_parallel.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Name = scoped::scoped<const char*>;
+static const bool name_propagated = scoped::context::propagate<Name>();
+
+int main(int argc, char** argv) {
+    assert(name_propagated);
+    const size_t n = 100000;
+
+    // Nested arenas can only narrow the limits of the enclosing arena
+    assert(scoped::task_arena::current_concurrency() == scoped::task_arena::default_concurrency());
+    {
+        scoped::task_arena outer(3, {0});
+        assert(outer.max_concurrency() == 3);
+        {
+            scoped::task_arena inner(8);
+            assert(inner.max_concurrency() == 3);
+            assert(inner.cpus() == std::vector<int>({0}));
+            assert(scoped::task_arena::current_concurrency() == 3);
+        }
+        scoped::task_arena narrower(2);
+        assert(scoped::task_arena::current_concurrency() == 2);
+    }
+
+    // An arena of one runs everything on the calling thread
+    {
+        scoped::task_arena arena(1);
+        std::atomic<bool> elsewhere(false);
+        auto caller = std::this_thread::get_id();
+        scoped::parallel_for(0, n, [&](size_t) {
+            if (std::this_thread::get_id() != caller) {
+                elsewhere = true;
+            }
+        });
+        assert(!elsewhere);
+    }
+
+    // Every index is visited once, and workers see the caller's scoped values and arena
+    {
+        scoped::task_arena arena(4);
+        Name name("request");
+        std::vector<std::atomic<int>> visits(n);
+        std::atomic<bool> wrong_scope(false);
+        std::mutex mutex;
+        std::set<std::thread::id> threads;
+        scoped::parallel_for(0, n, [&](size_t i) {
+            visits[i]++;
+            if (!Name::top() || std::string(Name::top()->value()) != "request" ||
+                scoped::task_arena::current_concurrency() != 4) {
+                wrong_scope = true;
+            }
+            if (i % 1000 == 0) {
+                std::lock_guard<std::mutex> lock(mutex);
+                threads.insert(std::this_thread::get_id());
+            }
+        }, 100);
+        assert(!wrong_scope);
+        for (auto& v : visits) {
+            assert(v == 1);
+        }
+        assert(threads.size() <= 4);
+    }
+
+    // Nested parallel work stays within the outer limit
+    {
+        scoped::task_arena arena(2);
+        std::atomic<int> running(0), peak(0);
+        scoped::parallel_for(0, 8, [&](size_t) {
+            scoped::parallel_for(0, 8, [&](size_t) {
+                int now = ++running;
+                for (int seen = peak; now > seen && !peak.compare_exchange_weak(seen, now);) {
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                --running;
+            });
+        });
+        assert(peak <= 2);
+    }
+
+    // Reductions equal the sequential result
+    {
+        scoped::task_arena arena(4);
+        long sum = scoped::parallel_reduce(size_t(0), n, 0L,
+            [](size_t first, size_t last, long acc) {
+                for (size_t i = first; i < last; ++i) acc += long(i);
+                return acc;
+            },
+            [](long a, long b) { return a + b; });
+        assert(sum == long(n * (n - 1) / 2));
+
+        // Merged in order, so non-commutative merges work too
+        std::vector<int> order = scoped::parallel_reduce(size_t(0), size_t(1000), std::vector<int>(),
+            [](size_t first, size_t last, std::vector<int> acc) {
+                for (size_t i = first; i < last; ++i) acc.push_back(int(i));
+                return acc;
+            },
+            [](std::vector<int> a, const std::vector<int>& b) {
+                a.insert(a.end(), b.begin(), b.end());
+                return a;
+            }, 10);
+        std::vector<int> expected(1000);
+        std::iota(expected.begin(), expected.end(), 0);
+        assert(order == expected);
+    }
+
+    // A grain of 0 is taken as 1
+    {
+        scoped::task_arena arena(4);
+        int calls = 0;
+        scoped::parallel_for(0, 1, [&](size_t) { ++calls; }, 0);
+        assert(calls == 1);
+        long sum = scoped::parallel_reduce(size_t(0), size_t(1), 7L,
+            [](size_t first, size_t last, long acc) { return acc + long(last - first); },
+            [](long a, long b) { return a + b; }, 0);
+        assert(sum == 8);
+    }
+
+    // Sorting equals the sequential sort
+    {
+        scoped::task_arena arena(4);
+        std::mt19937 gen(42);
+        std::vector<int> values(n);
+        for (auto& v : values) v = int(gen() % 1000);
+        auto expected = values;
+        std::sort(expected.begin(), expected.end(), std::greater<int>());
+        scoped::parallel_sort(values.begin(), values.end(), std::greater<int>());
+        assert(values == expected);
+    }
+
+    // Exceptions are rethrown in the caller
+    {
+        scoped::task_arena arena(4);
+        bool caught = false;
+        try {
+            scoped::parallel_for(0, n, [](size_t i) {
+                if (i == 777) throw std::runtime_error("failed");
+            });
+        }
+        catch (const std::runtime_error& e) {
+            caught = std::string(e.what()) == "failed";
+        }
+        assert(caught);
+    }
+
+    return 0;
+}
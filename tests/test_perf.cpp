@@ -0,0 +1,50 @@
+#include "scoped_perf.h"
+#include <thread>
+
+static const char* outer_tag = "outer";
+static const char* inner_tag = "inner";
+
+int work(int n) {
+    scoped::perf_region region(inner_tag);
+    assert(scoped::perf_region::top() == &region);
+    volatile int sum = 0;
+    for (int i = 0; i < n; ++i) {
+        sum += i;
+    }
+    return sum;
+}
+
+int main(int argc, char** argv) {
+    {
+        scoped::perf_region region(outer_tag);
+        for (int i = 0; i < 10; ++i) {
+            work(1000);
+        }
+        assert(scoped::perf_region::top() == &region);
+        assert(scoped::perf_region::top()->value().tag() == outer_tag);
+    }
+    assert(!scoped::perf_region::top());
+
+    std::thread worker([] {
+        scoped::perf_region region(outer_tag);
+        work(1000);
+    });
+    worker.join();
+
+    auto report = scoped::perf_report();
+    assert(report.size() == 2);
+    assert(report[0].tag == "inner");
+    assert(report[0].counts.calls == 11);
+    assert(report[1].tag == "outer");
+    assert(report[1].counts.calls == 2);
+    assert(report[1].counts.nanoseconds >= report[0].counts.nanoseconds);
+    if (scoped::perf_region::hardware_available()) {
+        assert(report[1].counts.instructions >= report[0].counts.instructions);
+    }
+
+    scoped::reset_perf_report();
+    for (auto& entry : scoped::perf_report()) {
+        assert(entry.counts.calls == 0);
+    }
+    return 0;
+}
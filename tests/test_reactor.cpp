@@ -0,0 +1,83 @@
+#include "scoped_reactor.h"
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <sys/eventfd.h>
+
+using RequestId = scoped::scoped<std::string>;
+static const bool request_id_propagated = scoped::context::propagate<RequestId>();
+
+static std::string current_request() {
+    return RequestId::top() ? RequestId::top()->value() : "none";
+}
+
+int main(int argc, char** argv) {
+    assert(request_id_propagated);
+
+    // bind() installs the captured values around each call
+    {
+        std::function<std::string(const std::string&)> f;
+        {
+            RequestId id("r1");
+            f = scoped::bind([](const std::string& suffix) { return current_request() + suffix; });
+        }
+        assert(current_request() == "none");
+        assert(f("!") == "r1!");
+        RequestId other("r2");
+        assert(f("?") == "r1?");
+        assert(current_request() == "r2");
+    }
+
+    // Reactor callbacks run in the scope of their registration
+    {
+        scoped::reactor loop;
+        int a = eventfd(0, EFD_NONBLOCK), b = eventfd(0, EFD_NONBLOCK);
+        std::vector<std::string> seen;
+        auto drain = [](int fd) {
+            uint64_t value;
+            return read(fd, &value, sizeof(value)) == sizeof(value);
+        };
+        {
+            RequestId id("a");
+            loop.add(a, EPOLLIN, [&, a](uint32_t events) {
+                assert(events & EPOLLIN);
+                drain(a);
+                seen.push_back(current_request());
+                RequestId nested("posted by a");
+                loop.post([&] { seen.push_back(current_request()); });
+            });
+        }
+        {
+            RequestId id("b");
+            loop.add(b, EPOLLIN, [&, b](uint32_t) {
+                drain(b);
+                seen.push_back(current_request());
+                loop.remove(b);
+            });
+        }
+        assert(loop.size() == 2);
+        assert(loop.run_once(0) == 0);
+
+        uint64_t one = 1;
+        assert(write(a, &one, sizeof(one)) == sizeof(one));
+        assert(write(b, &one, sizeof(one)) == sizeof(one));
+        size_t called = 0;
+        while (called < 3) {
+            called += loop.run_once(1000);
+        }
+        assert(called == 3);
+        assert(seen.size() == 3);
+        assert(std::count(seen.begin(), seen.end(), "a") == 1);
+        assert(std::count(seen.begin(), seen.end(), "b") == 1);
+        assert(seen.back() == "posted by a");
+        assert(loop.size() == 1);
+        assert(current_request() == "none");
+
+        loop.post([&] { loop.stop(); });
+        loop.run();
+        close(a);
+        close(b);
+    }
+
+    return 0;
+}
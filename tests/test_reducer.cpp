@@ -0,0 +1,96 @@
+#include "scoped_reducer.h"
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Sum = scoped::reducer<long>;
+
+struct set_union {
+    std::set<int> operator()(std::set<int> a, const std::set<int>& b) const {
+        a.insert(b.begin(), b.end());
+        return a;
+    }
+};
+using Seen = scoped::reducer<std::set<int>, set_union>;
+
+// Concatenation is associative, but not commutative
+using Text = scoped::reducer<std::string>;
+
+void visit(int i) {
+    Sum::top()->value().local() += i;
+    Seen::top()->value().local().insert(i % 10);
+}
+
+int main(int argc, char** argv) {
+    const int n = 10000;
+
+    long sequential;
+    {
+        Sum sum;
+        Seen seen;
+        for (int i = 0; i < n; ++i) {
+            visit(i);
+        }
+        sequential = sum.get();
+        assert(seen.get().size() == 10);
+    }
+
+    // More threads than shards, to exercise the overflow shards as well
+    Sum sum(0, std::plus<long>(), 3);
+    Seen seen;
+    auto ctx = scoped::context::capture();
+    std::vector<std::thread> threads;
+    const int num_threads = 6;
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&ctx, t] {
+            auto guard = ctx.install();
+            for (int i = t; i < n; i += num_threads) {
+                visit(i);
+            }
+        });
+    }
+    visit(0);
+    for (auto& t : threads) {
+        t.join();
+    }
+    assert(sum.get() == sequential);
+    assert(seen.get() == std::set<int>({0, 1, 2, 3, 4, 5, 6, 7, 8, 9}));
+
+    // Shards are reset by join, and the reducer keeps accumulating afterwards
+    std::thread([&ctx] {
+        auto guard = ctx.install();
+        visit(5);
+    }).join();
+    assert(sum.get() == sequential + 5);
+
+    // Shards indexed by chunk are merged in chunk order, whichever threads process the chunks. There are
+    // more chunks than shards, to exercise the indexed overflow as well.
+    {
+        const size_t chunks = 12;
+        Text text(std::string(), std::plus<std::string>(), 4);
+        std::string expected;
+        for (size_t c = 0; c < chunks; ++c) {
+            for (char ch = 'a'; ch < 'e'; ++ch) {
+                expected += char(ch + c);
+            }
+        }
+        auto text_ctx = scoped::context::capture();
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < 3; ++t) {
+            workers.emplace_back([&text_ctx, t, chunks] {
+                auto guard = text_ctx.install();
+                for (size_t c = chunks - 1 - t; c < chunks; c -= 3) {
+                    for (char ch = 'a'; ch < 'e'; ++ch) {
+                        Text::top()->value().local(c) += char(ch + c);
+                    }
+                }
+            });
+        }
+        for (auto& t : workers) {
+            t.join();
+        }
+        assert(text.get() == expected);
+    }
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include "scoped_rng.h"
+#include <thread>
+#include <vector>
+
+// Draws a few numbers from a stream keyed by task, derived from the caller's rng
+uint64_t task(int index) {
+    scoped::rng rng(index);
+    uint64_t sum = 0;
+    for (int i = 0; i < 10; ++i) {
+        sum = sum * 31 + rng.next_u32();
+    }
+    return sum;
+}
+
+int main(int argc, char** argv) {
+    // Same path of keys, same numbers
+    uint64_t first, second;
+    {
+        scoped::rng root(42);
+        first = root.next_u64();
+    }
+    {
+        scoped::rng root(42);
+        second = root.next_u64();
+        scoped::rng child(42);
+        assert(child.next_u64() != second);
+    }
+    assert(first == second);
+
+    // fill() draws the same sequence as next_u32()
+    {
+        std::vector<uint32_t> filled(1000), drawn;
+        {
+            scoped::rng rng(7);
+            filled[0] = rng.next_u32();
+            rng.fill(filled.data() + 1, filled.size() - 1);
+            double d[100];
+            rng.fill_uniform(d, 100);
+            for (double x : d) {
+                assert(x >= 0.0 && x < 1.0);
+            }
+        }
+        {
+            scoped::rng rng(7);
+            for (size_t i = 0; i < filled.size(); ++i) {
+                drawn.push_back(rng.next_u32());
+            }
+        }
+        assert(filled == drawn);
+    }
+
+    // Tasks draw the same numbers whichever thread runs them
+    scoped::rng root(2023);
+    std::vector<uint64_t> sequential;
+    for (int i = 0; i < 8; ++i) {
+        sequential.push_back(task(i));
+    }
+    std::vector<uint64_t> parallel(8);
+    auto ctx = scoped::context::capture();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 2; ++t) {
+        threads.emplace_back([&, t] {
+            auto guard = ctx.install();
+            for (int i = 7 - t; i >= 0; i -= 2) {
+                parallel[i] = task(i);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    assert(parallel == sequential);
+    return 0;
+}
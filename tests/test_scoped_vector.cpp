@@ -0,0 +1,93 @@
+#include "scoped_vector.h"
+#include <string>
+#include <type_traits>
+
+using Name = scoped::scoped<std::string, struct NameTag>;
+using Names = scoped::scoped_vector<std::string, struct NameTag>;
+
+struct Point {
+    long a, b;
+};
+
+// Returns the values of the chain from the bottom up.
+static std::string chain() {
+    std::string values;
+    for (auto p = Name::bottom(); p; p = p->prev()) {
+        values += p->value() + " ";
+    }
+    return values;
+}
+
+int main(int argc, char** argv) {
+    static_assert(std::is_nothrow_move_constructible<scoped::scoped<int>>::value, "");
+    static_assert(std::is_nothrow_move_assignable<scoped::scoped<int>>::value, "");
+
+    // Elements are pushed as they are added, and keep their places when the vector grows
+    {
+        Names names;
+        names.emplace_back("a");
+        Name b("b");
+        names.push_back("c");
+        for (int i = 0; i < 10; ++i) {
+            names.emplace_back(std::to_string(i));
+        }
+        assert(names.capacity() >= 12 && names.size() == 12);
+        assert(chain() == "a b c 0 1 2 3 4 5 6 7 8 9 ");
+        assert(Name::top()->value() == "9" && Name::bottom()->value() == "a");
+        assert(&names.node(3) == Name::top()->next()->next()->next()->next()->next()->next()->next()->next());
+        assert(names[1] == "c" && names.at(2) == "0" && names.back() == "9");
+
+        names.pop_back();
+        assert(Name::top()->value() == "8");
+        names.reserve(100);
+        assert(chain() == "a b c 0 1 2 3 4 5 6 7 8 ");
+        {
+            Name inner("inner");
+            names.emplace_back("x");
+            assert(chain() == "a b c 0 1 2 3 4 5 6 7 8 inner x ");
+        }
+        assert(chain() == "a b c 0 1 2 3 4 5 6 7 8 x ");
+
+        // Moving the vector does not move the elements
+        Names other(std::move(names));
+        assert(names.empty() && other.size() == 12);
+        assert(chain() == "a b c 0 1 2 3 4 5 6 7 8 x ");
+        other.clear();
+        assert(chain() == "b ");
+    }
+    assert(!Name::top() && !Name::bottom());
+
+    // A single element at the bottom and top of the chain
+    {
+        Names names;
+        names.emplace_back("only");
+        names.reserve(1000);
+        assert(Name::top() == &names.node(0) && Name::bottom() == &names.node(0));
+        Name above("above");
+        names.reserve(2000);
+        assert(chain() == "only above ");
+    }
+    assert(!Name::top() && !Name::bottom());
+
+    // Adding a copy of an element when the vector is full, as with std::vector
+    {
+        Names names;
+        for (int i = 0; i < 4; ++i) {
+            names.emplace_back(std::string(32, char('a' + i)));
+        }
+        Name above("above");
+        assert(names.size() == names.capacity());
+        names.push_back(names[0]);
+        assert(names.size() == 5 && names[4] == std::string(32, 'a'));
+        assert(Name::top() == &names.node(4) && Name::top()->next() == &above);
+
+        scoped::scoped_vector<Point> points;
+        for (long i = 0; i < 4; ++i) {
+            points.push_back(Point{i, -i});
+        }
+        points.push_back(points[3]);
+        assert(points[4].a == 3 && points[4].b == -3);
+    }
+    assert(!Name::top() && !Name::bottom());
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include "scoped_shm.h"
+#include <cstddef>
+#include <string>
+#include <sys/wait.h>
+
+struct knobs {
+    uint32_t batch_size;
+    double sample_rate;
+    uint64_t checks[4];
+};
+
+using Knobs = scoped::scoped<knobs, struct KnobsTag>;
+
+int main(int argc, char** argv) {
+    const std::string name = "/scoped_shm_test_" + std::to_string(getpid());
+    scoped::shm_segment::unlink(name);
+
+    // New segments hold a zero value, shared by all the handles
+    {
+        scoped::shm_global<knobs, struct KnobsTag> a(name), b(name);
+        assert(a.load().batch_size == 0 && a.version() == 0);
+        knobs k = {};
+        k.batch_size = 32;
+        k.sample_rate = 0.5;
+        a.store(k);
+        assert(b.load().batch_size == 32 && b.load().sample_rate == 0.5);
+        assert(b.version() == 1);
+
+        // Snapshots are scoped, and do not change with later stores
+        {
+            auto snapshot = b.snapshot();
+            k.batch_size = 64;
+            a.store(k);
+            assert(Knobs::top()->value().batch_size == 32);
+            assert(b.load().batch_size == 64);
+        }
+        assert(Knobs::top() == nullptr);
+    }
+
+    // Values of another size are rejected
+    {
+        bool thrown = false;
+        try {
+            scoped::shm_global<uint32_t> wrong(name);
+        }
+        catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+
+    // Untyped access updates single fields, as the writer tool does
+    {
+        scoped::shm_segment segment(name, 0, false);
+        assert(segment.value_size() == sizeof(knobs));
+        uint32_t batch_size = 128;
+        segment.write(&batch_size, sizeof(batch_size), offsetof(knobs, batch_size));
+        scoped::shm_global<knobs, struct KnobsTag> g(name);
+        assert(g.load().batch_size == 128 && g.load().sample_rate == 0.5);
+
+        bool thrown = false;
+        try {
+            segment.write(&batch_size, sizeof(batch_size), sizeof(knobs) - 2);
+        }
+        catch (const std::out_of_range&) {
+            thrown = true;
+        }
+        assert(thrown);
+    }
+
+    // Readers never see a torn value while another process stores
+    {
+        scoped::shm_global<knobs, struct KnobsTag> g(name);
+        g.store(knobs{});
+        pid_t child = fork();
+        if (child == 0) {
+            scoped::shm_global<knobs, struct KnobsTag> writer(name);
+            knobs k = {};
+            for (uint64_t i = 1; i <= 20000; ++i) {
+                k.batch_size = uint32_t(i);
+                for (auto& check : k.checks) check = i;
+                writer.store(k);
+            }
+            _exit(0);
+        }
+        uint64_t last = 0;
+        for (int i = 0; i < 200000; ++i) {
+            knobs k = g.load();
+            for (auto check : k.checks) {
+                assert(check == k.batch_size);
+            }
+            assert(k.batch_size >= last);
+            last = k.batch_size;
+        }
+        int status = 0;
+        waitpid(child, &status, 0);
+        assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        assert(g.load().batch_size == 20000);
+    }
+
+    // Removed segments are created anew
+    assert(scoped::shm_segment::unlink(name));
+    assert(!scoped::shm_segment::unlink(name));
+    {
+        scoped::shm_global<knobs, struct KnobsTag> g(name);
+        assert(g.load().batch_size == 0);
+    }
+    scoped::shm_segment::unlink(name);
+    return 0;
+}
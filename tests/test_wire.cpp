@@ -0,0 +1,108 @@
+#include "scoped_wire.h"
+#include <stdexcept>
+#include <string>
+
+// A type whose decoder throws on values it rejects
+struct Quota {
+    int64_t limit;
+};
+
+template<> struct scoped::wire_traits<Quota> {
+    static void encode(const Quota& value, std::string& out) { wire_traits<int64_t>::encode(value.limit, out); }
+
+    static bool decode(const char* data, size_t size, Quota& value) {
+        if (!wire_traits<int64_t>::decode(data, size, value.limit)) return false;
+        if (value.limit < 0) throw std::domain_error("negative quota");
+        return true;
+    }
+};
+
+using Tenant = scoped::scoped<std::string_view, struct TenantTag>;
+using Deadline = scoped::scoped<int64_t, struct DeadlineTag>;
+using Trace = scoped::scoped<std::string, struct TraceTag>;
+enum class Mode : uint8_t { normal, dry_run };
+using ScopedMode = scoped::scoped<Mode>;
+using Unshipped = scoped::scoped<int, struct UnshippedTag>;
+using ScopedQuota = scoped::scoped<Quota>;
+
+static const bool shipped = scoped::wire::propagate<Tenant>(1) && scoped::wire::propagate<Deadline>(2) &&
+    scoped::wire::propagate<Trace>(3) && scoped::wire::propagate<ScopedMode>(4) &&
+    scoped::wire::propagate<ScopedQuota>(5);
+
+int main(int argc, char** argv) {
+    assert(shipped);
+
+    // An empty context encodes to a bare header
+    std::string empty;
+    scoped::wire::encode(empty);
+    assert(empty.size() == scoped::wire::header_size);
+
+    std::string message;
+    {
+        Tenant tenant("acme");
+        Deadline deadline(1234567890123);
+        Trace trace("trace-42");
+        ScopedMode mode(Mode::dry_run);
+        Unshipped unshipped(7);
+        scoped::wire::encode(message);
+    }
+    message += "payload";
+
+    // Decoding installs the values; string views point into the buffer
+    {
+        size_t consumed = 0;
+        auto guard = scoped::wire::install(message.data(), message.size(), &consumed);
+        assert(guard.size() == 4);
+        assert(message.substr(consumed) == "payload");
+        assert(Tenant::top()->value() == "acme");
+        assert(Tenant::top()->value().data() >= message.data() &&
+               Tenant::top()->value().data() < message.data() + message.size());
+        assert(Deadline::top()->value() == 1234567890123);
+        assert(Trace::top()->value() == "trace-42");
+        assert(ScopedMode::top()->value() == Mode::dry_run);
+        assert(!Unshipped::top());
+    }
+    assert(!Tenant::top() && !Deadline::top());
+
+    // Unknown ids are skipped
+    {
+        std::string unknown = message.substr(0, message.size() - 7);
+        unknown[8] = char(99);
+        auto guard = scoped::wire::install(unknown.data(), unknown.size());
+        assert(guard.size() == 3 && !Tenant::top() && Deadline::top());
+    }
+
+    // Malformed headers are rejected
+    auto rejected = [](const std::string& bytes) {
+        try {
+            scoped::wire::install(bytes.data(), bytes.size());
+        }
+        catch (const scoped::wire_error&) {
+            return true;
+        }
+        return false;
+    };
+    assert(rejected("nope"));
+    assert(rejected(message.substr(0, 12)));
+    std::string bad_version = message;
+    bad_version[2] = 9;
+    assert(rejected(bad_version));
+    assert(!Deadline::top());
+
+    // Exceptions thrown by decoders unlink the instances already decoded
+    std::string negative;
+    {
+        Tenant tenant("acme");
+        ScopedQuota quota(Quota{-1});
+        scoped::wire::encode(negative);
+    }
+    try {
+        scoped::wire::install(negative.data(), negative.size());
+        assert(false);
+    }
+    catch (const std::domain_error&) {
+    }
+    assert(!Tenant::top() && !ScopedQuota::top());
+
+    return 0;
+}
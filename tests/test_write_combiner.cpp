@@ -0,0 +1,58 @@
+#include "scoped_write_combiner.h"
+#include <thread>
+#include <vector>
+
+scoped::combined_counter requests;
+scoped::combined_counter bytes(100);
+
+void read_block(int n) {
+    ++requests;
+    bytes += n;
+}
+
+int main(int argc, char** argv) {
+    read_block(10);
+    assert(requests.load() == 1 && bytes.load() == 110);
+
+    {
+        scoped::write_combiner combiner;
+        read_block(10);
+        read_block(20);
+        assert(requests.load() == 1 && bytes.load() == 110);
+        {
+            scoped::write_combiner nested;
+            read_block(5);
+        }
+        assert(requests.load() == 2 && bytes.load() == 115);
+        combiner.flush();
+        assert(requests.load() == 4 && bytes.load() == 145);
+        read_block(1);
+    }
+    assert(requests.load() == 5 && bytes.load() == 146);
+
+    // Counters that do not fit in the table go directly to the atomic
+    {
+        std::vector<scoped::combined_counter> counters(scoped::write_combiner::capacity + 1);
+        scoped::write_combiner combiner;
+        for (auto& counter : counters) {
+            counter.add(1);
+        }
+        assert(counters.front().load() == 0);
+        assert(counters.back().load() == 1);
+    }
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([] {
+            scoped::write_combiner combiner;
+            for (int i = 0; i < 1000; ++i) {
+                read_block(1);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    assert(requests.load() == 4005 && bytes.load() == 4146);
+    return 0;
+}
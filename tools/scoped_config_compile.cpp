@@ -0,0 +1,65 @@
+// Compiles configuration text (key = value lines) to the binary format loaded by scoped::config_file.
+//
+// Usage: scoped_config_compile input.conf output.scfg
+//
+// The output is replaced atomically, so that services that have it mapped keep seeing the old version.
+
+#include "scoped_config.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        std::cerr << "usage: " << argv[0] << " input.conf output.scfg\n";
+        return 2;
+    }
+    std::ifstream input(argv[1], std::ios::binary);
+    if (!input) {
+        std::cerr << argv[1] << ": cannot open\n";
+        return 1;
+    }
+    std::stringstream text;
+    text << input.rdbuf();
+
+    std::string binary;
+    try {
+        binary = scoped::compile_config(text.str());
+    }
+    catch (const scoped::config_error& e) {
+        std::cerr << argv[1] << ": " << e.what() << "\n";
+        return 1;
+    }
+
+    // Running services keep the output mapped, so it is replaced rather than rewritten in place: the
+    // binary goes to a temporary file in the same directory, which is then renamed over the output.
+    std::string temporary = std::string(argv[2]) + ".XXXXXX";
+    int fd = mkstemp(&temporary[0]);
+    if (fd < 0) {
+        std::cerr << argv[2] << ": cannot create a temporary file next to it\n";
+        return 1;
+    }
+    mode_t mask = umask(0);
+    umask(mask);
+    bool written = fchmod(fd, 0666 & ~mask) == 0;
+    for (size_t done = 0; written && done < binary.size();) {
+        ssize_t n = ::write(fd, binary.data() + done, binary.size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        written = n > 0;
+        done += written ? size_t(n) : 0;
+    }
+    written = ::close(fd) == 0 && written;
+    if (!written || std::rename(temporary.c_str(), argv[2]) != 0) {
+        std::cerr << argv[2] << ": cannot write\n";
+        std::remove(temporary.c_str());
+        return 1;
+    }
+    return 0;
+}
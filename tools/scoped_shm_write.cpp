@@ -0,0 +1,111 @@
+// Updates a field of a value published with scoped::shm_global, atomically for its readers.
+//
+// Usage: scoped_shm_write name offset type value
+//        scoped_shm_write name                     (prints the value in hex)
+//
+// type is one of i8 i16 i32 i64 u8 u16 u32 u64 f32 f64, or hex for a string of hex digits. offset is the
+// byte offset of the field in the value, e.g. offsetof(knobs, batch_size).
+
+#include "scoped_shm.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+template<class T> static std::vector<unsigned char> bytes_of(T value) {
+    std::vector<unsigned char> bytes(sizeof(T));
+    std::memcpy(bytes.data(), &value, sizeof(T));
+    return bytes;
+}
+
+// Parses an unsigned decimal, hex (0x) or octal (0) integer. Returns false if text is malformed, negative
+// or out of range.
+static bool parse_unsigned(const std::string& text, uint64_t& value) {
+    char* end = nullptr;
+    errno = 0;
+    value = std::strtoull(text.c_str(), &end, 0);
+    return !text.empty() && text.find('-') == std::string::npos && !*end && end != text.c_str() && errno != ERANGE;
+}
+
+// Converts text to the bytes of a value of the given type. Returns false if the type is unknown or the
+// text malformed.
+static bool parse(const std::string& type, const std::string& text, std::vector<unsigned char>& bytes) {
+    char* end = nullptr;
+    if (type == "hex") {
+        if (text.size() % 2) return false;
+        for (size_t i = 0; i < text.size(); i += 2) {
+            std::string digits = text.substr(i, 2);
+            unsigned long byte = std::strtoul(digits.c_str(), &end, 16);
+            if (*end) return false;
+            bytes.push_back((unsigned char)byte);
+        }
+        return true;
+    }
+    if (type == "f32" || type == "f64") {
+        double value = std::strtod(text.c_str(), &end);
+        if (*end || end == text.c_str()) return false;
+        bytes = type == "f32" ? bytes_of(float(value)) : bytes_of(value);
+        return true;
+    }
+    if (type.size() < 2 || (type[0] != 'i' && type[0] != 'u')) return false;
+    std::string width = type.substr(1);
+    int bits = width == "8" ? 8 : width == "16" ? 16 : width == "32" ? 32 : width == "64" ? 64 : 0;
+    if (!bits) return false;
+    // Values that do not fit in the field are rejected, rather than truncated.
+    uint64_t raw;
+    errno = 0;
+    if (type[0] == 'i') {
+        long long value = std::strtoll(text.c_str(), &end, 0);
+        if (*end || end == text.c_str() || errno == ERANGE) return false;
+        if (bits < 64 && (value < -(1LL << (bits - 1)) || value >= (1LL << (bits - 1)))) return false;
+        raw = uint64_t(value);
+    }
+    else {
+        // strtoull accepts negative numbers, and negates them.
+        if (!parse_unsigned(text, raw)) return false;
+        if (bits < 64 && (raw >> bits)) return false;
+    }
+    if (bits == 8) bytes = bytes_of(uint8_t(raw));
+    else if (bits == 16) bytes = bytes_of(uint16_t(raw));
+    else if (bits == 32) bytes = bytes_of(uint32_t(raw));
+    else bytes = bytes_of(raw);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2 && argc != 5) {
+        std::cerr << "usage: " << argv[0] << " name [offset type value]\n";
+        return 2;
+    }
+    try {
+        scoped::shm_segment segment(argv[1], 0, false);
+        if (argc == 2) {
+            std::vector<unsigned char> value(segment.value_size());
+            segment.read(value.data());
+            for (unsigned char byte : value) {
+                std::printf("%02x", byte);
+            }
+            std::printf("\n");
+            return 0;
+        }
+        std::vector<unsigned char> bytes;
+        if (!parse(argv[3], argv[4], bytes)) {
+            std::cerr << argv[4] << ": not a valid " << argv[3] << " value\n";
+            return 2;
+        }
+        uint64_t offset;
+        if (!parse_unsigned(argv[2], offset)) {
+            std::cerr << argv[2] << ": not a valid offset\n";
+            return 2;
+        }
+        segment.write(bytes.data(), bytes.size(), size_t(offset));
+    }
+    catch (const std::exception& e) {
+        std::cerr << argv[1] << ": " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}